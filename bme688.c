@@ -1,7 +1,14 @@
-#include "/usr/local/include/util/string.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
 
-#include "main.c"
-#include "config.h"
+#include "pico/stdlib.h"
+
+#include "hardware/i2c.h"
+
+#include "bme688_profile.h"
+#include "sensor.h"
+#include "settings.h"
 
 enum {
 	BME_I2C_ADDR = 0x76,
@@ -60,28 +67,69 @@ enum bme_reg {
 	BME_REG_HUM_ADC_0_MSB	= 0x25, /* hum_adc[15:8] */
 	BME_REG_HUM_ADC_0_LSB	= 0x26, /* hum_adc[7:0] */
 
+	BME_REG_PAR_G1		= 0xED,
+	BME_REG_PAR_G2_LSB	= 0xEB,
+	BME_REG_PAR_G2_MSB	= 0xEC,
+	BME_REG_PAR_G3		= 0xEE,
+	BME_REG_RES_HEAT_VAL	= 0x00,
+	BME_REG_RES_HEAT_RANGE	= 0x02, /* <5:4> */
+
+	/* One register per heater profile step */
+	BME_REG_IDAC_HEAT_0	= 0x50,
+	BME_REG_RES_HEAT_0	= 0x5A,
+	BME_REG_GAS_WAIT_0	= 0x64,
+	BME_REG_GAS_WAIT_SHARED	= 0x6E,
+
+	/* heat_off<3> */
+	BME_REG_CTRL_GAS_0	= 0x70,
+	/* run_gas<5:4>, nb_conv<3:0> */
+	BME_REG_CTRL_GAS_1	= 0x71,
 	/* spi_3w_int_en<6,6>, osrs_h<2:0> */
 	BME_REG_CTRL_HUM	= 0x72,
 	/* osrs_t<7:5>, osrs_p<4:2>, mode<1:0>  */
 	BME_REG_CTRL_MEAS	= 0x74,
+	/* filter<4:2>, spi_3w_en<0> */
+	BME_REG_CONFIG		= 0x75,
 	/* new_data<7> */
 	BME_REG_MEAS_STATUS	= 0x1D,
+
+	/* Parallel mode cycles through three data fields. */
+	BME_REG_FIELD_0		= 0x1D,
 };
 
-enum bme_ctrl {
-	BME_OVERSAMPLE_0x = 0x0,
-	BME_OVERSAMPLE_1x = 0x1,
-	BME_OVERSAMPLE_2x = 0x2,
-	BME_OVERSAMPLE_4x = 0x3,
-	BME_OVERSAMPLE_8x = 0x4,
-	BME_OVERSAMPLE_16x = 0x5,
+/* Offsets within a data field. */
+enum bme_field {
+	/* new_data<7>, gas_measuring<6>, measuring<5>, gas_meas_index<3:0> */
+	BME_FIELD_STATUS	= 0,
+	BME_FIELD_SUB_MEAS	= 1,
+	BME_FIELD_PRESS		= 2,
+	BME_FIELD_TEMP		= 5,
+	BME_FIELD_HUM		= 8,
+	/* gas_adc<9:2>, then gas_adc<1:0><7:6>, gas_valid<5>, heat_stab<4>, gas_range<3:0> */
+	BME_FIELD_GAS		= 15,
+
+	BME_FIELD_LEN		= 17,
+	BME_FIELDS		= 3,
+};
 
+enum bme_ctrl {
 	BME_MODE_SLEEP		= 0x0,
 	BME_MODE_FORCED		= 0x1,
 	BME_MODE_PARALLEL	= 0x2,
+
+	BME_HEAT_OFF		= 1 << 3,
+	BME_RUN_GAS		= 0x2 << 4,
+
+	BME_NEW_DATA		= 1 << 7,
+	BME_GAS_VALID		= 1 << 5,
+	BME_HEAT_STAB		= 1 << 4,
 };
 
-void bme_reg_write(unsigned char reg, unsigned char data)
+/* How often to check for completed parallel mode cycles.
+ * Three fields are buffered, so this can be well over one cycle. */
+static const unsigned BME_POLL_MS = 100;
+
+static void bme_reg_write(unsigned char reg, unsigned char data)
 {
 	unsigned char buf[] = { reg, data };
 	int ret = i2c_write_blocking(our_i2c, BME_I2C_ADDR, buf, 2, false);
@@ -92,7 +140,7 @@ void bme_reg_write(unsigned char reg, unsigned char data)
 	}
 }
 
-unsigned char bme_reg_read(unsigned char reg)
+static unsigned char bme_reg_read(unsigned char reg)
 {
 	unsigned char data = 0;
 	if (i2c_write_blocking(our_i2c, BME_I2C_ADDR, &reg, 1, false) != 1) {
@@ -104,7 +152,7 @@ unsigned char bme_reg_read(unsigned char reg)
 	return data;
 }
 
-void bme_reg_reads(unsigned char reg, size_t num, unsigned char *buffer)
+static void bme_reg_reads(unsigned char reg, size_t num, unsigned char *buffer)
 {
 	if (i2c_write_blocking(our_i2c, BME_I2C_ADDR, &reg, 1, false) != 1) {
 		fatal_error(ERROR_BME_READ_SEND);
@@ -114,119 +162,352 @@ void bme_reg_reads(unsigned char reg, size_t num, unsigned char *buffer)
 	}
 }
 
-void measure_init(void)
+struct bme_calib {
+	uint16_t par_t1;
+	int16_t par_t2;
+	int8_t par_t3;
+
+	uint16_t par_p1;
+	int16_t par_p2;
+	int8_t par_p3;
+	int16_t par_p4;
+	int16_t par_p5;
+	int8_t par_p6;
+	int8_t par_p7;
+	int16_t par_p8;
+	int16_t par_p9;
+	uint8_t par_p10;
+
+	uint16_t par_h1;
+	uint16_t par_h2;
+	int8_t par_h3;
+	int8_t par_h4;
+	int8_t par_h5;
+	uint8_t par_h6;
+	int8_t par_h7;
+
+	int8_t par_g1;
+	int16_t par_g2;
+	int8_t par_g3;
+	uint8_t res_heat_range;
+	int8_t res_heat_val;
+};
+
+static struct bme_calib calib;
+
+struct bme_sample {
+	double temp;
+	double press;
+	double humid;
+};
+
+/* Latest results while sequencing a heater profile in parallel mode. */
+static struct {
+	uint8_t steps;
+	uint8_t last_sub_meas;
+	bool seen;
+	uint64_t next_poll;
+	struct bme_sample tph;
+	double gas[GAS_STEPS_MAX];
+} parallel;
+
+/* Ambient temperature for the heater resistance calculation. */
+static double amb_temp = 25.0;
+
+static void bme_calib_read(void)
+{
+	calib.par_t1 = bme_reg_read(BME_REG_PAR_T1_LSB) | (bme_reg_read(BME_REG_PAR_T1_MSB) << 8);
+	calib.par_t2 = bme_reg_read(BME_REG_PAR_T2_LSB) | (bme_reg_read(BME_REG_PAR_T2_MSB) << 8);
+	calib.par_t3 = bme_reg_read(BME_REG_PAR_T3);
+
+	calib.par_p1 = bme_reg_read(BME_REG_PAR_P1_LSB) | (bme_reg_read(BME_REG_PAR_P1_MSB) << 8);
+	calib.par_p2 = bme_reg_read(BME_REG_PAR_P2_LSB) | (bme_reg_read(BME_REG_PAR_P2_MSB) << 8);
+	calib.par_p3 = bme_reg_read(BME_REG_PAR_P3);
+	calib.par_p4 = bme_reg_read(BME_REG_PAR_P4_LSB) | (bme_reg_read(BME_REG_PAR_P4_MSB) << 8);
+	calib.par_p5 = bme_reg_read(BME_REG_PAR_P5_LSB) | (bme_reg_read(BME_REG_PAR_P5_MSB) << 8);
+	calib.par_p6 = bme_reg_read(BME_REG_PAR_P6);
+	calib.par_p7 = bme_reg_read(BME_REG_PAR_P7);
+	calib.par_p8 = bme_reg_read(BME_REG_PAR_P8_LSB) | (bme_reg_read(BME_REG_PAR_P8_MSB) << 8);
+	calib.par_p9 = bme_reg_read(BME_REG_PAR_P9_LSB) | (bme_reg_read(BME_REG_PAR_P9_MSB) << 8);
+	calib.par_p10 = bme_reg_read(BME_REG_PAR_P10);
+
+	calib.par_h1 = (bme_reg_read(BME_REG_PAR_H1_LSB) & 0x0F) | (bme_reg_read(BME_REG_PAR_H1_MSB) << 4);
+	calib.par_h2 = (bme_reg_read(BME_REG_PAR_H2_LSB) >> 4) | (bme_reg_read(BME_REG_PAR_H2_MSB) << 4);
+	calib.par_h3 = bme_reg_read(BME_REG_PAR_H3);
+	calib.par_h4 = bme_reg_read(BME_REG_PAR_H4);
+	calib.par_h5 = bme_reg_read(BME_REG_PAR_H5);
+	calib.par_h6 = bme_reg_read(BME_REG_PAR_H6);
+	calib.par_h7 = bme_reg_read(BME_REG_PAR_H7);
+
+	calib.par_g1 = bme_reg_read(BME_REG_PAR_G1);
+	calib.par_g2 = bme_reg_read(BME_REG_PAR_G2_LSB) | (bme_reg_read(BME_REG_PAR_G2_MSB) << 8);
+	calib.par_g3 = bme_reg_read(BME_REG_PAR_G3);
+	calib.res_heat_range = (bme_reg_read(BME_REG_RES_HEAT_RANGE) >> 4) & 0x3;
+	calib.res_heat_val = bme_reg_read(BME_REG_RES_HEAT_VAL);
+}
+
+/* Compensation formulas are the floating point ones from the datasheet. */
+
+static double bme_temp(uint32_t temp_adc, double *t_fine)
 {
-	/* osrs_h */
-	bme_reg_write(BME_REG_CTRL_HUM, BME_OVERSAMPLE_16x);
+	double var1, var2;
+	var1 = (((double)temp_adc / 16384.0) - ((double)calib.par_t1 / 1024.0)) * (double)calib.par_t2;
+	var2 = ((((double)temp_adc / 131072.0) - ((double)calib.par_t1 / 8192.0)) *
+		(((double)temp_adc / 131072.0) - ((double)calib.par_t1 / 8192.0))) *
+		((double)calib.par_t3 * 16.0);
+	*t_fine = var1 + var2;
+	return *t_fine / 5120.0;
 }
 
-struct measurement *measure_take(void)
+static double bme_press(uint32_t press_adc, double t_fine)
 {
-	static struct measurement ms[] = {
-		{ .name = "temp", .type = "gauge", .value = NULL },
-		{ .name = "pressure", .type = "gauge", .value = NULL },
-		{ .name = "humid", .type = "gauge", .value = NULL },
-		{ 0 },
-	};
+	double var1, var2, var3, press_comp;
+
+	var1 = ((double)t_fine / 2.0) - 64000.0;
+	var2 = var1 * var1 * ((double)calib.par_p6 / 131072.0);
+	var2 = var2 + (var1 * (double)calib.par_p5 * 2.0);
+	var2 = (var2 / 4.0) + ((double)calib.par_p4 * 65536.0);
+	var1 = ((((double)calib.par_p3 * var1 * var1) / 16384.0) +
+		((double)calib.par_p2 * var1)) / 524288.0;
+	var1 = (1.0 + (var1 / 32768.0)) * (double)calib.par_p1;
+	press_comp = 1048576.0 - (double)press_adc;
+	if (var1 == 0.0)
+		return 0.0;
+
+	press_comp = ((press_comp - (var2 / 4096.0)) * 6250.0) / var1;
+	var1 = ((double)calib.par_p9 * press_comp * press_comp) / 2147483648.0;
+	var2 = press_comp * ((double)calib.par_p8 / 32768.0);
+	var3 = (press_comp / 256.0) * (press_comp / 256.0) *
+		(press_comp / 256.0) * (calib.par_p10 / 131072.0);
+	return press_comp + (var1 + var2 + var3 +
+		((double)calib.par_p7 * 128.0)) / 16.0;
+}
 
-	/* osrs_t, osrs_p, mode  */
-	bme_reg_write(BME_REG_CTRL_MEAS, BME_MODE_FORCED | (BME_OVERSAMPLE_16x << 2) | (BME_OVERSAMPLE_16x << 5));
+static double bme_humid(uint32_t hum_adc, double temp_comp)
+{
+	const double
+		var1 = hum_adc - (((double)calib.par_h1 * 16.0) + (((double)calib.par_h3 / 2.0) * temp_comp)),
+		var2 = var1 * (((double)calib.par_h2 / 262144.0) * (1.0 + (((double)calib.par_h4 / 16384.0) *
+			temp_comp) + (((double)calib.par_h5 / 1048576.0) * temp_comp * temp_comp))),
+		var3 = (double)calib.par_h6 / 16384.0,
+		var4 = (double)calib.par_h7 / 2097152.0;
+	return var2 + ((var3 + (var4 * temp_comp)) * var2 * var2);
+}
 
-	do {
-		sleep_ms(1000);
-	} while (~bme_reg_read(BME_REG_MEAS_STATUS) & (1 << 7));
+/* BME688 gas resistance in ohms; the range selects a power of two divider. */
+static double bme_gas(uint16_t gas_adc, uint8_t gas_range)
+{
+	const uint32_t var1 = UINT32_C(262144) >> gas_range;
+	const int32_t var2 = 4096 + ((int32_t)gas_adc - 512) * 3;
+	return 1000000.0 * (double)var1 / (double)var2;
+}
 
-	const uint16_t par_t1 = bme_reg_read(BME_REG_PAR_T1_LSB) | (bme_reg_read(BME_REG_PAR_T1_MSB) << 8),
-		 par_t2 = bme_reg_read(BME_REG_PAR_T2_LSB) | (bme_reg_read(BME_REG_PAR_T2_MSB) << 8),
-		 par_t3 = bme_reg_read(BME_REG_PAR_T3);
+/* Target heater resistance register value for a heater temperature. */
+static unsigned char bme_res_heat(unsigned temp_c)
+{
+	if (temp_c > 400)
+		temp_c = 400;
+
+	const double
+		var1 = ((double)calib.par_g1 / 16.0) + 49.0,
+		var2 = (((double)calib.par_g2 / 32768.0) * 0.0005) + 0.00235,
+		var3 = (double)calib.par_g3 / 1024.0,
+		var4 = var1 * (1.0 + (var2 * (double)temp_c)),
+		var5 = var4 + (var3 * amb_temp);
+	return 3.4 * ((var5 * (4.0 / (4.0 + (double)calib.res_heat_range)) *
+		(1.0 / (1.0 + ((double)calib.res_heat_val * 0.002)))) - 25);
+}
 
-	const uint32_t temp_adc =
-		(bme_reg_read(BME_REG_TEMP_ADC_0_MSB) << 12) |
-		(bme_reg_read(BME_REG_TEMP_ADC_0_LSB) << 4) |
-		(bme_reg_read(BME_REG_TEMP_ADC_0_XLSB) >> 4);
+/* gas_wait_shared counts 0.477ms steps, with a x1/x4/x16/x64 multiplier. */
+static unsigned char bme_gas_wait_shared(uint32_t dur_ms)
+{
+	if (dur_ms >= 0x783)
+		return 0xFF;
+
+	uint32_t steps = dur_ms * 1000 / 477;
+	unsigned char factor = 0;
+	while (steps > 0x3F) {
+		steps >>= 2;
+		factor++;
+	}
+	return steps | (factor << 6);
+}
 
+static void bme_field_decode(const unsigned char *field, struct bme_sample *out)
+{
+	const uint32_t
+		press_adc = (field[BME_FIELD_PRESS] << 12) | (field[BME_FIELD_PRESS + 1] << 4) | (field[BME_FIELD_PRESS + 2] >> 4),
+		temp_adc = (field[BME_FIELD_TEMP] << 12) | (field[BME_FIELD_TEMP + 1] << 4) | (field[BME_FIELD_TEMP + 2] >> 4),
+		hum_adc = (field[BME_FIELD_HUM] << 8) | field[BME_FIELD_HUM + 1];
+
+	double t_fine;
+	out->temp = bme_temp(temp_adc, &t_fine);
+	out->press = bme_press(press_adc, t_fine);
+	out->humid = bme_humid(hum_adc, out->temp);
+	amb_temp = out->temp;
+}
 
-	double temp_comp, t_fine;
-	{
-		double var1, var2;
-		var1 = (((double)temp_adc / 16384.0) - ((double)par_t1 / 1024.0)) * (double)par_t2;
-		var2 = ((((double)temp_adc / 131072.0) - ((double)par_t1 / 8192.0)) *
-			(((double)temp_adc / 131072.0) - ((double)par_t1 / 8192.0))) *
-			((double)par_t3 * 16.0);
-		t_fine = var1 + var2;
-		temp_comp = t_fine / 5120.0;
+static double bme_field_gas(const unsigned char *field)
+{
+	const unsigned char lsb = field[BME_FIELD_GAS + 1];
+	if (!(lsb & BME_GAS_VALID) || !(lsb & BME_HEAT_STAB))
+		return NAN;
+
+	const uint16_t gas_adc = (field[BME_FIELD_GAS] << 2) | (lsb >> 6);
+	return bme_gas(gas_adc, lsb & 0x0F);
+}
+
+/* osrs_h, then osrs_t, osrs_p and mode, which starts the conversion. */
+static void bme_start(const struct bme_profile *profile, unsigned char mode)
+{
+	bme_reg_write(BME_REG_CTRL_HUM, profile->osrs_h);
+	bme_reg_write(BME_REG_CTRL_MEAS, mode | (profile->osrs_p << 2) | (profile->osrs_t << 5));
+}
+
+static void bme688_init(void)
+{
+	bme_calib_read();
+
+	const struct bme_profile *profile = &bme_profiles[settings.bme_profile];
+
+	/* Configuration is only accepted in sleep mode. */
+	bme_reg_write(BME_REG_CTRL_MEAS, BME_MODE_SLEEP);
+	bme_reg_write(BME_REG_CONFIG, profile->filter << 2);
+
+	parallel.steps = settings.gas_steps;
+	parallel.seen = false;
+	parallel.next_poll = 0;
+	parallel.tph = (struct bme_sample){ NAN, NAN, NAN };
+	for (int i = 0; i < GAS_STEPS_MAX; i++)
+		parallel.gas[i] = NAN;
+
+	if (!parallel.steps) {
+		bme_reg_write(BME_REG_CTRL_GAS_0, BME_HEAT_OFF);
+		bme_reg_write(BME_REG_CTRL_GAS_1, 0);
+		return;
+	}
+
+	/* The heater runs for whatever is left of each cycle after TPH,
+	 * and each step lasts a whole number of cycles. */
+	const uint32_t meas_ms = bme_profile_dur_us(profile, true) / 1000;
+	const uint32_t shared_ms = meas_ms < BME_HEATER_CYCLE_MS ? BME_HEATER_CYCLE_MS - meas_ms : 0;
+	bme_reg_write(BME_REG_GAS_WAIT_SHARED, bme_gas_wait_shared(shared_ms));
+
+	for (int i = 0; i < parallel.steps; i++) {
+		const struct gas_step *step = &settings.gas_profile[i];
+		uint32_t cycles = (step->dur_ms + BME_HEATER_CYCLE_MS - 1) / BME_HEATER_CYCLE_MS;
+		bme_reg_write(BME_REG_RES_HEAT_0 + i, bme_res_heat(step->temp_c));
+		bme_reg_write(BME_REG_IDAC_HEAT_0 + i, 0);
+		bme_reg_write(BME_REG_GAS_WAIT_0 + i, cycles > 0xFF ? 0xFF : cycles);
 	}
 
+	bme_reg_write(BME_REG_CTRL_GAS_0, 0);
+	bme_reg_write(BME_REG_CTRL_GAS_1, BME_RUN_GAS | parallel.steps);
+
+	/* The sensor now sequences the profile by itself,
+	 * and bme688_poll() collects the results. */
+	bme_start(profile, BME_MODE_PARALLEL);
+}
 
-	const uint16_t
-		par_p1 = bme_reg_read(BME_REG_PAR_P1_LSB) | (bme_reg_read(BME_REG_PAR_P1_MSB) << 8),
-		par_p2 = bme_reg_read(BME_REG_PAR_P2_LSB) | (bme_reg_read(BME_REG_PAR_P2_MSB) << 8),
-		par_p3 = bme_reg_read(BME_REG_PAR_P3),
-		par_p4 = bme_reg_read(BME_REG_PAR_P4_LSB) | (bme_reg_read(BME_REG_PAR_P4_MSB) << 8),
-		par_p5 = bme_reg_read(BME_REG_PAR_P5_LSB) | (bme_reg_read(BME_REG_PAR_P5_MSB) << 8),
-		par_p6 = bme_reg_read(BME_REG_PAR_P6),
-		par_p7 = bme_reg_read(BME_REG_PAR_P7),
-		par_p8 = bme_reg_read(BME_REG_PAR_P8_LSB) | (bme_reg_read(BME_REG_PAR_P8_MSB) << 8),
-		par_p9 = bme_reg_read(BME_REG_PAR_P9_LSB) | (bme_reg_read(BME_REG_PAR_P9_MSB) << 8),
-		par_p10 = bme_reg_read(BME_REG_PAR_P10);
-
-	const uint32_t press_adc =
-		(bme_reg_read(BME_REG_PRESS_ADC_0_MSB) << 12) |
-		(bme_reg_read(BME_REG_PRESS_ADC_0_LSB) << 4) |
-		(bme_reg_read(BME_REG_PRESS_ADC_0_XLSB) >> 4);
-
-	double press_comp;
-	{
-		double var1, var2, var3;
-
-		var1 = ((double)t_fine / 2.0) - 64000.0;
-		var2 = var1 * var1 * ((double)par_p6 / 131072.0);
-		var2 = var2 + (var1 * (double)par_p5 * 2.0);
-		var2 = (var2 / 4.0) + ((double)par_p4 * 65536.0);
-		var1 = ((((double)par_p3 * var1 * var1) / 16384.0) +
-			((double)par_p2 * var1)) / 524288.0;
-		var1 = (1.0 + (var1 / 32768.0)) * (double)par_p1;
-		press_comp = 1048576.0 - (double)press_adc;
-		if (var1 != 0.0) {
-			press_comp = ((press_comp - (var2 / 4096.0)) * 6250.0) / var1;
-			var1 = ((double)par_p9 * press_comp * press_comp) / 2147483648.0;
-			var2 = press_comp * ((double)par_p8 / 32768.0);
-			var3 = (press_comp / 256.0) * (press_comp / 256.0) *
-				(press_comp / 256.0) * (par_p10 / 131072.0);
-			press_comp = press_comp + (var1 + var2 + var3 +
-				((double)par_p7 * 128.0)) / 16.0;
-		} else {
-			press_comp = 0.0;
+static void bme688_poll(void)
+{
+	if (!parallel.steps || time_us_64() < parallel.next_poll)
+		return;
+	parallel.next_poll = time_us_64() + 1000ull * BME_POLL_MS;
+
+	unsigned char fields[BME_FIELDS][BME_FIELD_LEN];
+	bme_reg_reads(BME_REG_FIELD_0, sizeof(fields), &fields[0][0]);
+
+	/* Fields are filled in turn; sub_meas_index orders them. Apply them
+	 * oldest first, so a newer result for the same heater step wins. */
+	int order[BME_FIELDS];
+	uint8_t ages[BME_FIELDS];
+	int count = 0;
+	for (int i = 0; i < BME_FIELDS; i++) {
+		const unsigned char *field = fields[i];
+		if (!(field[BME_FIELD_STATUS] & BME_NEW_DATA))
+			continue;
+
+		const uint8_t age = field[BME_FIELD_SUB_MEAS] - parallel.last_sub_meas;
+		if (parallel.seen && (age == 0 || age >= 0x80))
+			continue;
+
+		int j = count++;
+		for (; j > 0 && ages[j - 1] > age; j--) {
+			order[j] = order[j - 1];
+			ages[j] = ages[j - 1];
 		}
+		order[j] = i;
+		ages[j] = age;
 	}
 
-	const uint16_t
-		par_h1 = (bme_reg_read(BME_REG_PAR_H1_LSB) & 0x0F) | (bme_reg_read(BME_REG_PAR_H1_MSB) << 4),
-		par_h2 = (bme_reg_read(BME_REG_PAR_H2_LSB) >> 4) | (bme_reg_read(BME_REG_PAR_H2_MSB) << 4),
-		par_h3 = bme_reg_read(BME_REG_PAR_H3),
-		par_h4 = bme_reg_read(BME_REG_PAR_H4),
-		par_h5 = bme_reg_read(BME_REG_PAR_H5),
-		par_h6 = bme_reg_read(BME_REG_PAR_H6),
-		par_h7 = bme_reg_read(BME_REG_PAR_H7);
-
-	const uint32_t hum_adc =
-		bme_reg_read(BME_REG_HUM_ADC_0_LSB) | (bme_reg_read(BME_REG_HUM_ADC_0_MSB) << 8);
-
-	double hum_comp;
-	{
-		const double
-			var1 = hum_adc - (((double)par_h1 * 16.0) + (((double)par_h3 / 2.0) * temp_comp)),
-			var2 = var1 * (((double)par_h2 / 262144.0) * (1.0 + (((double)par_h4 / 16384.0) *
-				temp_comp) + (((double)par_h5 / 1048576.0) * temp_comp * temp_comp))),
-			var3 = (double)par_h6 / 16384.0,
-			var4 = (double)par_h7 / 2097152.0;
-		hum_comp = var2 + ((var3 + (var4 * temp_comp)) * var2 * var2);
+	for (int j = 0; j < count; j++) {
+		const unsigned char *field = fields[order[j]];
+		const uint8_t step = field[BME_FIELD_STATUS] & 0x0F;
+		if (step < parallel.steps)
+			parallel.gas[step] = bme_field_gas(field);
 	}
 
-	ms[0].value = rsprintf(ms[0].value, "%f", temp_comp);
-	ms[1].value = rsprintf(ms[1].value, "%f", press_comp);
-	ms[2].value = rsprintf(ms[2].value, "%f", hum_comp);
+	const int newest = count ? order[count - 1] : -1;
+	if (newest >= 0) {
+		bme_field_decode(fields[newest], &parallel.tph);
+		parallel.last_sub_meas = fields[newest][BME_FIELD_SUB_MEAS];
+		parallel.seen = true;
+	}
+}
+
+static struct measurement *bme688_take(void)
+{
+	static struct measurement ms[3 + GAS_STEPS_MAX + 1] = {
+		{ .name = "temp", .type = "gauge" },
+		{ .name = "pressure", .type = "gauge" },
+		{ .name = "humid", .type = "gauge" },
+		{ 0 },
+	};
+	static char labels[GAS_STEPS_MAX][32];
+
+	struct bme_sample sample;
+
+	if (parallel.steps) {
+		sample = parallel.tph;
+	} else {
+		const struct bme_profile *profile = &bme_profiles[settings.bme_profile];
+
+		bme_start(profile, BME_MODE_FORCED);
+
+		/* Sleep for the datasheet conversion time, so the first status
+		 * read normally finds the data ready. */
+		sleep_us(bme_profile_dur_us(profile, false));
+		while (~bme_reg_read(BME_REG_MEAS_STATUS) & BME_NEW_DATA) {
+			sleep_ms(1);
+		}
+
+		unsigned char field[BME_FIELD_LEN];
+		bme_reg_reads(BME_REG_FIELD_0, sizeof(field), field);
+		bme_field_decode(field, &sample);
+	}
+
+	ms[0].value = sample.temp;
+	ms[1].value = sample.press;
+	ms[2].value = sample.humid;
+
+	/* One gas resistance per heater step, in ohms. */
+	for (int i = 0; i < parallel.steps; i++) {
+		struct measurement *m = &ms[3 + i];
+		snprintf(labels[i], sizeof(labels[i]), "step=\"%d\",heater_c=\"%u\"",
+			i, settings.gas_profile[i].temp_c);
+		m->name = "gas_resistance";
+		m->type = "gauge";
+		m->labels = labels[i];
+		m->value = parallel.gas[i];
+	}
+	ms[3 + parallel.steps].name = NULL;
 
 	return ms;
 }
 
+const struct sensor_driver bme688_driver = {
+	.init = bme688_init,
+	.take = bme688_take,
+	.poll = bme688_poll,
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* BME688 measurement profiles, kept free of SDK includes so that
+ * tools/bme_profile_bench.c can model them on the host. */
+
+enum bme_oversample {
+	BME_OVERSAMPLE_0x = 0x0,
+	BME_OVERSAMPLE_1x = 0x1,
+	BME_OVERSAMPLE_2x = 0x2,
+	BME_OVERSAMPLE_4x = 0x3,
+	BME_OVERSAMPLE_8x = 0x4,
+	BME_OVERSAMPLE_16x = 0x5,
+};
+
+/* IIR filter coefficient, config register filter<4:2> */
+enum bme_filter {
+	BME_FILTER_0 = 0x0,
+	BME_FILTER_1 = 0x1,
+	BME_FILTER_3 = 0x2,
+	BME_FILTER_7 = 0x3,
+	BME_FILTER_15 = 0x4,
+	BME_FILTER_31 = 0x5,
+	BME_FILTER_63 = 0x6,
+	BME_FILTER_127 = 0x7,
+};
+
+enum bme_profile_id {
+	BME_PROFILE_PRECISE = 0,
+	BME_PROFILE_WEATHER,
+	BME_PROFILE_INDOOR,
+	BME_PROFILE_FAST,
+	BME_PROFILES,
+};
+
+struct bme_profile {
+	uint8_t osrs_t;
+	uint8_t osrs_p;
+	uint8_t osrs_h;
+	uint8_t filter;
+	uint32_t interval_ms;
+};
+
+static const char *const bme_profile_names[] = {
+	[BME_PROFILE_PRECISE]	= "precise",
+	[BME_PROFILE_WEATHER]	= "weather",
+	[BME_PROFILE_INDOOR]	= "indoor",
+	[BME_PROFILE_FAST]	= "fast",
+	[BME_PROFILES]		= NULL,
+};
+
+static const struct bme_profile bme_profiles[BME_PROFILES] = {
+	/* Maximum oversampling everywhere, as originally shipped. */
+	[BME_PROFILE_PRECISE] = {
+		.osrs_t = BME_OVERSAMPLE_16x, .osrs_p = BME_OVERSAMPLE_16x, .osrs_h = BME_OVERSAMPLE_16x,
+		.filter = BME_FILTER_0, .interval_ms = 10'000,
+	},
+	/* Datasheet weather monitoring: single samples, once a minute. */
+	[BME_PROFILE_WEATHER] = {
+		.osrs_t = BME_OVERSAMPLE_1x, .osrs_p = BME_OVERSAMPLE_1x, .osrs_h = BME_OVERSAMPLE_1x,
+		.filter = BME_FILTER_0, .interval_ms = 60'000,
+	},
+	/* Low noise pressure, with the IIR filter smoothing draughts. */
+	[BME_PROFILE_INDOOR] = {
+		.osrs_t = BME_OVERSAMPLE_2x, .osrs_p = BME_OVERSAMPLE_16x, .osrs_h = BME_OVERSAMPLE_1x,
+		.filter = BME_FILTER_3, .interval_ms = 10'000,
+	},
+	/* Short conversions and no filter lag. */
+	[BME_PROFILE_FAST] = {
+		.osrs_t = BME_OVERSAMPLE_1x, .osrs_p = BME_OVERSAMPLE_2x, .osrs_h = BME_OVERSAMPLE_1x,
+		.filter = BME_FILTER_0, .interval_ms = 1'000,
+	},
+};
+
+/* Length of one TPHG cycle in parallel mode, of which what is left after
+ * the TPH conversion is spent heating. Each heater step lasts a whole
+ * number of cycles, at most 0xFF. */
+enum {
+	BME_HEATER_CYCLE_MS = 140,
+	BME_HEATER_STEP_MAX_MS = 0xFF * BME_HEATER_CYCLE_MS,
+};
+
+/* Conversion cycles for each oversampling setting, 1.963ms each. */
+static const uint8_t bme_oversample_cycles[] = { 0, 1, 2, 4, 8, 16 };
+
+/* Duration of the TPH(G) conversion for the given oversampling. */
+static inline uint32_t bme_meas_dur_us(unsigned osrs_t, unsigned osrs_p, unsigned osrs_h, bool parallel)
+{
+	uint32_t dur = (bme_oversample_cycles[osrs_t] + bme_oversample_cycles[osrs_p] +
+		bme_oversample_cycles[osrs_h]) * 1963;
+	dur += 477 * 4;		/* TPH switching */
+	dur += 477 * 5;		/* Gas measurement */
+	if (!parallel)
+		dur += 1000;	/* Wake up */
+	return dur;
+}
+
+static inline uint32_t bme_profile_dur_us(const struct bme_profile *p, bool parallel)
+{
+	return bme_meas_dur_us(p->osrs_t, p->osrs_p, p->osrs_h, parallel);
+}
@@ -0,0 +1,30 @@
+# cmake -DSIZE=<size> -DELFS="name=elf|..." -DOUTPUT=<file> -P size_report.cmake
+#
+# Flash is text + data, since initialised data is copied out of flash at
+# boot, and RAM is data + bss.
+
+if (NOT SIZE)
+	message(FATAL_ERROR "arm-none-eabi-size not found")
+endif()
+
+string(REPLACE "|" ";" elfs "${ELFS}")
+set(report "firmware\tflash\tram\n")
+foreach (entry IN LISTS elfs)
+	string(REGEX REPLACE "=.*" "" name "${entry}")
+	string(REGEX REPLACE "^[^=]*=" "" elf "${entry}")
+
+	execute_process(COMMAND ${SIZE} -B ${elf} OUTPUT_VARIABLE out RESULT_VARIABLE result)
+	if (NOT result EQUAL 0)
+		message(FATAL_ERROR "${SIZE} failed on ${elf}")
+	endif()
+
+	# Second line: text data bss dec hex filename
+	string(REGEX MATCH "\n[ \t]*([0-9]+)[ \t]+([0-9]+)[ \t]+([0-9]+)" _ "${out}")
+	math(EXPR flash "${CMAKE_MATCH_1} + ${CMAKE_MATCH_2}")
+	math(EXPR ram "${CMAKE_MATCH_2} + ${CMAKE_MATCH_3}")
+
+	string(APPEND report "${name}\t${flash}\t${ram}\n")
+endforeach()
+
+message("${report}")
+file(WRITE ${OUTPUT} "${report}")
@@ -3,21 +3,30 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+/* Compile-time defaults, used until settings are saved to flash. */
+
 #ifdef WLAN_SSID
-static const char *const wlan_ssid = WLAN_SSID;
-static const char *const wlan_pass = WLAN_PASS;
+static const char *const default_wlan_ssid = WLAN_SSID;
+static const char *const default_wlan_pass = WLAN_PASS;
 #else
 #error Should define WLAN_SSID
-static const char *const wlan_ssid = NULL;
-static const char *const wlan_pass = NULL;
+static const char *const default_wlan_ssid = NULL;
+static const char *const default_wlan_pass = NULL;
 #endif
 
 enum {
-	tcp_port = 80,
+	default_tcp_port = 80,
 
-	our_sda_pin = 0,
-	our_clk_pin = 1,
-};
+	default_i2c_bus = 0,
+	default_sda_pin = 0,
+	default_clk_pin = 1,
 
-#define our_i2c i2c0
+	default_heater_every = 60,
+	default_sample_interval_ms = 10'000,
+
+	default_push_port = 8125,
+	default_push_interval_ms = 60'000,
+};
 
+/* Administratively scoped multicast, see RFC 2365. */
+static const char *const default_push_addr = "239.255.72.84";
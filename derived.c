@@ -0,0 +1,50 @@
+#include <math.h>
+
+#include "derived.h"
+
+static const float MAGNUS_A = 6.112f;
+static const float MAGNUS_B = 17.62f;
+static const float MAGNUS_C = 243.12f;
+
+/* The SHT4x conversion can overshoot both ends; Sensirion recommends
+ * cropping to 0..100 %RH. */
+static float clamp_humid(float humid)
+{
+	if (humid < 0.0f)
+		return 0.0f;
+	return humid > 100.0f ? 100.0f : humid;
+}
+
+float saturation_vp(float temp)
+{
+	return MAGNUS_A * expf(MAGNUS_B * temp / (MAGNUS_C + temp));
+}
+
+float dew_point(float temp, float humid)
+{
+	if (!(humid > 0.0f))
+		return NAN;
+
+	const float gamma = logf(clamp_humid(humid) / 100.0f) + MAGNUS_B * temp / (MAGNUS_C + temp);
+	return MAGNUS_C * gamma / (MAGNUS_B - gamma);
+}
+
+float abs_humid(float temp, float humid)
+{
+	/* Ideal gas law for water vapour: 100 / R_v = 216.7 g K / (m^3 hPa) */
+	const float vp = saturation_vp(temp) * clamp_humid(humid) / 100.0f;
+	return 216.7f * vp / (273.15f + temp);
+}
+
+float vpd(float temp, float humid)
+{
+	/* hPa to kPa */
+	return saturation_vp(temp) * (100.0f - clamp_humid(humid)) / 1000.0f;
+}
+
+float sea_level_pressure(float press, float temp, float altitude_m)
+{
+	/* Hypsometric formula with the standard 6.5 K/km lapse rate. */
+	const float lapse = 0.0065f * altitude_m;
+	return press * powf(1.0f - lapse / (temp + lapse + 273.15f), -5.257f);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+/* Quantities derived from a single temperature/humidity/pressure sample.
+ * Single precision throughout: the RP2040 has fast float routines in ROM
+ * but only soft double. tools/derived_bench.c checks these against the
+ * double precision formulas. Temperatures in C, humidity in %RH, which
+ * is clamped to 0..100. */
+
+/* Saturation vapour pressure over water (Magnus, Sonntag 1990), in hPa */
+float saturation_vp(float temp);
+
+/* Dew point in C, NaN for non-positive humidity */
+float dew_point(float temp, float humid);
+
+/* Absolute humidity in g/m^3 */
+float abs_humid(float temp, float humid);
+
+/* Vapour-pressure deficit in kPa */
+float vpd(float temp, float humid);
+
+/* Pressure reduced to sea level, same unit as press */
+float sea_level_pressure(float press, float temp, float altitude_m);
@@ -93,6 +93,7 @@
 #define MDNS_RESP_USENETIF_EXTCALLBACK  1
 #define MEMP_NUM_SYS_TIMEOUT 10
 #define MEMP_NUM_TCP_PCB 12
+#define SO_REUSE 1
 
 #if !NO_SYS
 #define TCPIP_THREAD_STACKSIZE 2048 // mDNS needs more stack
@@ -0,0 +1,174 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+
+#include "push.h"
+#include "sensor.h"
+#include "settings.h"
+
+static struct udp_pcb *push_pcb = NULL;
+static ip_addr_t push_ip;
+static uint32_t push_seq = 0;
+static uint64_t next_push = 0;
+
+#if SENSOR_PUSH_BINARY
+/* name{labels}, as in the scrape output. */
+static void push_entry_name(char *buf, size_t size, const struct measurement *m)
+{
+	if (m->labels)
+		snprintf(buf, size, "%s{%s}", m->name, m->labels);
+	else
+		snprintf(buf, size, "%s", m->name);
+}
+
+static size_t push_binary(const struct measurement *ms, uint8_t *buf, size_t size)
+{
+	struct push_header header = {
+		.magic = lwip_htonl(PUSH_MAGIC),
+		.version = PUSH_VERSION,
+		.seq = lwip_htonl(push_seq),
+		.uptime_ms = lwip_htonl(to_ms_since_boot(get_absolute_time())),
+	};
+	const size_t host_len = strlen(settings.hostname);
+	memcpy(header.host, settings.hostname, host_len < sizeof(header.host) ? host_len : sizeof(header.host));
+
+	/* Names first, as many as fit along with their values. */
+	size_t len = sizeof(header);
+	for (const struct measurement *m = ms; m->name && header.count < PUSH_ENTRIES_MAX; m++) {
+		char name[PUSH_NAME_MAX];
+		push_entry_name(name, sizeof(name), m);
+		const size_t n = strlen(name) + 1;
+		if (len + n + 3 + (header.count + 1) * sizeof(uint32_t) > size)
+			break;
+		memcpy(buf + len, name, n);
+		len += n;
+		header.count++;
+	}
+	while (len % 4)
+		buf[len++] = '\0';
+	header.names_len = lwip_htons(len - sizeof(header));
+
+	for (int i = 0; i < header.count; i++) {
+		const float value = ms[i].value;
+		uint32_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		bits = lwip_htonl(bits);
+		memcpy(buf + len, &bits, sizeof(bits));
+		len += sizeof(bits);
+	}
+
+	memcpy(buf, &header, sizeof(header));
+	return len;
+}
+#endif
+
+#if SENSOR_PUSH_INFLUX
+/* InfluxDB line protocol: one line for the unlabelled entries, then one
+ * per labelled entry with its labels as tags. NaN has no encoding, so
+ * those fields are left out. */
+static size_t push_influx(const struct measurement *ms, uint8_t *buf, size_t size)
+{
+	char *out = (char *)buf;
+	size_t len = snprintf(out, size, "env,host=%s seq=%luu", settings.hostname, (unsigned long)push_seq);
+
+	for (const struct measurement *m = ms; m->name && len < size; m++) {
+		if (!m->labels && !isnan(m->value))
+			len += snprintf(out + len, size - len, ",%s=%f", m->name, m->value);
+	}
+
+	for (const struct measurement *m = ms; m->name && len < size; m++) {
+		if (!m->labels || isnan(m->value))
+			continue;
+
+		len += snprintf(out + len, size - len, "\nenv,host=%s", settings.hostname);
+		/* step="0",heater_c="320" becomes ,step=0,heater_c=320 */
+		if (len < size)
+			out[len++] = ',';
+		for (const char *c = m->labels; *c && len < size; c++) {
+			if (*c != '"')
+				out[len++] = *c;
+		}
+		if (len < size)
+			len += snprintf(out + len, size - len, " %s=%f", m->name, m->value);
+	}
+
+	if (len < size)
+		out[len++] = '\n';
+	return len < size ? len : size;
+}
+#endif
+
+typedef size_t (*push_format_fn)(const struct measurement *ms, uint8_t *buf, size_t size);
+
+/* Formats left out of this firmware stay NULL, and cannot be enabled. */
+static const push_format_fn push_formats[PUSH_FORMATS] = {
+	[PUSH_OFF] = NULL,
+#if SENSOR_PUSH_BINARY
+	[PUSH_BINARY] = push_binary,
+#endif
+#if SENSOR_PUSH_INFLUX
+	[PUSH_INFLUX] = push_influx,
+#endif
+};
+
+void push_start(void)
+{
+	if (settings.push == PUSH_OFF)
+		return;
+	if (!push_formats[settings.push]) {
+		printf("push: format not built into this firmware, not pushing\n");
+		return;
+	}
+	if (!ipaddr_aton(settings.push_addr, &push_ip)) {
+		printf("push: bad push_addr %s, not pushing\n", settings.push_addr);
+		return;
+	}
+
+	push_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+	if (!push_pcb) {
+		fatal_error(ERROR_CREATE_PCB);
+	}
+	udp_set_multicast_ttl(push_pcb, settings.push_ttl);
+	next_push = 0;
+}
+
+void push_stop(void)
+{
+	if (!push_pcb)
+		return;
+	udp_remove(push_pcb);
+	push_pcb = NULL;
+}
+
+/* Send each new sample that passed a deadband, and at least every
+ * push_interval_ms regardless. */
+void push_poll(void)
+{
+	static uint8_t buf[PUSH_DATAGRAM_MAX];
+
+	bool changed;
+	if (!push_pcb || !sampler_fresh(&changed))
+		return;
+	if (!changed && time_us_64() < next_push)
+		return;
+
+	const size_t len = push_formats[settings.push](sampler_latest(), buf, sizeof(buf));
+
+	/* A dropped datagram, including one lwIP has no memory for right
+	 * now, shows up as a gap in seq at the collector. */
+	struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, len, PBUF_RAM);
+	if (p) {
+		memcpy(p->payload, buf, len);
+		udp_sendto(push_pcb, p, &push_ip, settings.push_port);
+		pbuf_free(p);
+	}
+
+	push_seq++;
+	next_push = time_us_64() + 1000ull * settings.push_interval_ms;
+}
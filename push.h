@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Binary UDP snapshot layout, shared with tools/push_recv.c.
+ * Integers and float bit patterns are big endian.
+ *
+ * A datagram is the header, then count NUL terminated name{labels}
+ * strings, NUL padded to a multiple of four to make names_len, then
+ * count float values packed in the same order. */
+
+#define PUSH_MAGIC	0x50534854 /* "PSHT" */
+#define PUSH_VERSION	2
+#define PUSH_ENTRIES_MAX 32
+/* Longest name{labels}, including the NUL */
+#define PUSH_NAME_MAX	64
+/* One unfragmented datagram on Ethernet */
+#define PUSH_DATAGRAM_MAX 1472
+
+struct push_header {
+	uint32_t magic;
+	uint8_t version;
+	uint8_t count;
+	uint16_t names_len;
+	/* Incremented per datagram, for loss detection */
+	uint32_t seq;
+	uint32_t uptime_ms;
+	/* NUL padded, only terminated if shorter than the 32 characters a
+	 * hostname may have */
+	char host[32];
+};
+
+_Static_assert(sizeof(struct push_header) == 48, "push_header layout");
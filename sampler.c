@@ -0,0 +1,183 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "derived.h"
+#include "sensor.h"
+#include "settings.h"
+
+static struct measurement *latest = NULL;
+static size_t latest_cap = 0;
+/* Whether any entry of the latest sample passed its deadband. */
+static bool latest_changed = false;
+/* Whether the latest sample is yet to be handed to sampler_fresh(). */
+static bool latest_fresh = false;
+static uint64_t next_sample = 0;
+
+/* Last reported value of each entry, for deadband reporting. */
+static struct reported {
+	double value;
+	uint64_t at;
+	bool valid;
+} *reported = NULL;
+static size_t reported_cap = 0;
+/* Only entries with a deadband are counted. */
+static uint32_t samples_total = 0, samples_suppressed = 0;
+
+enum {
+	DERIVED_MAX = 4,
+	SAMPLER_EXTRA = 1,
+};
+
+const struct measurement *measurement_find(const struct measurement *ms, const char *name)
+{
+	for (; ms->name; ms++) {
+		if (strcmp(ms->name, name) == 0)
+			return ms;
+	}
+	return NULL;
+}
+
+#if SENSOR_DERIVED
+/* Append quantities derived from the same sample to the first n entries,
+ * returning the new count. */
+static size_t derive(struct measurement *ms, size_t n)
+{
+	ms[n].name = NULL;
+	const struct measurement
+		*temp = measurement_find(ms, "temp"),
+		*humid = measurement_find(ms, "humid"),
+		*press = measurement_find(ms, "pressure");
+
+	struct measurement *d = ms + n;
+	if (temp && humid) {
+		*d++ = (struct measurement){ .name = "dew_point", .type = "gauge",
+			.value = dew_point(temp->value, humid->value) };
+		*d++ = (struct measurement){ .name = "abs_humid", .type = "gauge",
+			.value = abs_humid(temp->value, humid->value) };
+		*d++ = (struct measurement){ .name = "vpd", .type = "gauge",
+			.value = vpd(temp->value, humid->value) };
+	}
+	if (temp && press) {
+		*d++ = (struct measurement){ .name = "sea_level_pressure", .type = "gauge",
+			.value = sea_level_pressure(press->value, temp->value, settings.altitude_m) };
+	}
+
+	return d - ms;
+}
+#endif
+
+#if SENSOR_DEADBAND
+static const struct deadband *deadband_find(const char *name)
+{
+	for (int i = 0; i < settings.deadbands; i++) {
+		if (strcmp(settings.deadband[i].name, name) == 0)
+			return &settings.deadband[i];
+	}
+	return NULL;
+}
+
+/* Coalesce entries that moved less than their deadband since they were
+ * last reported, unless that was over their max silence ago.
+ * Returns whether anything is to be reported. */
+static bool deadband_apply(struct measurement *ms, size_t n)
+{
+	const uint64_t now = time_us_64();
+
+	if (reported_cap < n) {
+		reported = realloc(reported, n * sizeof(*reported));
+		memset(reported + reported_cap, 0, (n - reported_cap) * sizeof(*reported));
+		reported_cap = n;
+	}
+
+	bool changed = false;
+	for (size_t i = 0; i < n; i++) {
+		const struct deadband *db = deadband_find(ms[i].name);
+		struct reported *r = &reported[i];
+
+		if (db)
+			samples_total++;
+		if (db && r->valid &&
+		    isnan(ms[i].value) == isnan(r->value) &&
+		    !(fabs(ms[i].value - r->value) >= db->band) &&
+		    !(db->silence_s && now - r->at >= 1000ull * 1000 * db->silence_s)) {
+			ms[i].value = r->value;
+			samples_suppressed++;
+			continue;
+		}
+
+		*r = (struct reported){ .value = ms[i].value, .at = now, .valid = true };
+		changed = true;
+	}
+	return changed;
+}
+#endif
+
+/* Start afresh after the table layout or deadbands may have changed. */
+void sampler_reset(void)
+{
+	next_sample = 0;
+	reported_cap = 0;
+	samples_total = 0;
+	samples_suppressed = 0;
+}
+
+void sampler_poll(void)
+{
+	if (time_us_64() < next_sample)
+		return;
+
+	const struct measurement *ms = driver->take();
+	size_t n = 0;
+	while (ms[n].name)
+		n++;
+
+	const size_t cap = n + DERIVED_MAX + SAMPLER_EXTRA + 1;
+	if (latest_cap < cap) {
+		latest = realloc(latest, cap * sizeof(*latest));
+		latest_cap = cap;
+	}
+	memcpy(latest, ms, n * sizeof(*latest));
+
+#if SENSOR_DERIVED
+	if (settings.derived)
+		n = derive(latest, n);
+#endif
+
+#if SENSOR_DEADBAND
+	if (settings.deadbands) {
+		latest_changed = deadband_apply(latest, n);
+		latest[n++] = (struct measurement){
+			.name = "sampler_suppressed_ratio", .type = "gauge",
+			.value = samples_total ? (double)samples_suppressed / samples_total : 0.0,
+		};
+	} else
+#endif
+	{
+		latest_changed = true;
+	}
+	latest[n].name = NULL;
+	latest_fresh = true;
+
+	next_sample = time_us_64() + 1000ull * settings.sample_interval_ms;
+}
+
+const struct measurement *sampler_latest(void)
+{
+	if (!latest) {
+		next_sample = 0;
+		sampler_poll();
+	}
+	return latest;
+}
+
+bool sampler_fresh(bool *changed)
+{
+	if (!latest_fresh)
+		return false;
+	latest_fresh = false;
+	*changed = latest_changed;
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+struct measurement {
+	const char *name;
+	const char *type;
+	/* Optional, e.g. step="0". Entries sharing a name must be adjacent. */
+	const char *labels;
+	double value;
+};
+
+struct sensor_driver {
+	void (*init)(void);
+	/* Returns a table terminated by an entry without a name. */
+	struct measurement *(*take)(void);
+	/* Called every loop, for drivers that sequence the sensor themselves. */
+	void (*poll)(void);
+};
+
+extern const struct sensor_driver sht4x_driver;
+extern const struct sensor_driver sht3x_driver;
+extern const struct sensor_driver bme688_driver;
+
+/* Picked at compile time by add_sensor_firmware(), so the linker drops
+ * the other drivers. */
+extern const struct sensor_driver *const driver;
+
+enum error {
+	ERROR_GENERIC = 1,
+	ERROR_INIT,
+	ERROR_WLAN,
+	ERROR_MDNS,
+	ERROR_CREATE_PCB,
+	ERROR_BIND,
+	ERROR_LISTEN,
+	ERROR_FINISH,
+	ERROR_ACCEPT,
+	ERROR_WRITE_PART,
+	ERROR_WRITE_PART_MEM,
+	ERROR_WRITE_BEGIN,
+	ERROR_WRITE_BEGIN_MEM,
+	ERROR_CHECKSUM_TEST,
+	ERROR_SERVICE_TXT,
+	ERROR_CLOSE,
+	ERROR_FINAL,
+};
+
+void led_on(bool x);
+void flash_error(int err);
+void fatal_error(int err);
+
+const struct measurement *measurement_find(const struct measurement *ms, const char *name);
+/* OpenMetrics spelling, "NaN" for not-a-number. */
+void format_value(char *buf, size_t size, double value);
+
+/* sampler.c */
+void sampler_poll(void);
+void sampler_reset(void);
+/* Latest sample, taking one first if there is none yet. */
+const struct measurement *sampler_latest(void);
+/* True once per new sample; *changed is set if any entry passed its deadband. */
+bool sampler_fresh(bool *changed);
+
+/* server.c */
+void server_start(void);
+/* Only rebinds if tcp_port changed. */
+void server_rebind(void);
+
+/* push.c */
+void push_start(void);
+void push_stop(void);
+void push_poll(void);
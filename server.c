@@ -0,0 +1,180 @@
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "lwip/pbuf.h"
+#include "lwip/tcp.h"
+
+#include "/usr/local/include/util/string.h"
+
+#include "sensor.h"
+#include "settings.h"
+
+struct session {
+	u16_t rem_to_send;
+	u16_t queued;
+	u16_t rem_to_queue;
+	char *data;
+};
+
+#define min(x, y) ( (x) < (y) ? (x) : (y) )
+
+static err_t server_sent(void *arg, struct tcp_pcb *pcb, u16_t len)
+{
+	struct session *session = (struct session*)arg;
+	session->rem_to_send -= len;
+	if (session->rem_to_send == 0) {
+		free(session->data);
+		free(session);
+		tcp_arg(pcb, NULL);
+		tcp_sent(pcb, NULL);
+		tcp_close(pcb);
+	} else {
+		u16_t to_queue = min(tcp_sndbuf(pcb), session->rem_to_queue);
+		err_t err = tcp_write(pcb, session->data + session->queued, to_queue, 0);
+		tcp_output(pcb);
+		if (err == ERR_OK) {
+			session->queued += to_queue;
+			session->rem_to_queue -= to_queue;
+		} else if (err != ERR_MEM) {
+			fatal_error(ERROR_WRITE_PART);
+		}
+	}
+	return ERR_OK;
+}
+
+/* OpenMetrics spells not-a-number "NaN". */
+void format_value(char *buf, size_t size, double value)
+{
+	if (isnan(value))
+		snprintf(buf, size, "NaN");
+	else
+		snprintf(buf, size, "%f", value);
+}
+
+static err_t server_accept(void *, struct tcp_pcb *pcb, err_t err)
+{
+	if (err != ERR_OK || !pcb) {
+		fatal_error(ERROR_ACCEPT);
+		return ERR_VAL;
+	}
+
+	/* Serve the latest sample. */
+	struct session *arg = calloc(1, sizeof(struct session));
+	const struct measurement *ms = sampler_latest();
+	arg->data = rstrcpy(
+		NULL, 
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: application/openmetrics-text; version=1.0.0; charset=utf-8\r\n"
+		"\r\n"
+	);
+
+	const char *prev = NULL;
+	while (ms->name) {
+		if (!prev || strcmp(prev, ms->name) != 0) {
+			arg->data = rsprintf(arg->data, "%s# TYPE %s %s\n", arg->data, ms->name, ms->type);
+		}
+		char value[32];
+		format_value(value, sizeof(value), ms->value);
+		arg->data = rsprintf(
+			arg->data,
+			"%s"
+			"%s%s%s%s %s\n",
+			arg->data,
+			ms->name,
+			ms->labels ? "{" : "", ms->labels ? ms->labels : "", ms->labels ? "}" : "",
+			value
+		);
+		prev = ms->name;
+		ms++;
+	}
+	arg->data = rstrcat(arg->data, "# EOF\n");
+
+	arg->rem_to_send = strlen(arg->data);
+	u16_t to_queue = min(arg->rem_to_send, tcp_sndbuf(pcb));
+	arg->queued = to_queue;
+	arg->rem_to_queue = arg->rem_to_send - to_queue;
+	tcp_arg(pcb, arg);
+	tcp_sent(pcb, server_sent);
+
+	err_t newerr = tcp_write(pcb, arg->data, to_queue, 0);
+	if (newerr == ERR_MEM) {
+		fatal_error(ERROR_WRITE_BEGIN_MEM);
+	} else if (newerr != ERR_OK) {
+		fatal_error(ERROR_WRITE_BEGIN);
+	}
+	tcp_output(pcb);
+
+	return ERR_OK;
+}
+
+static struct tcp_pcb *listen_pcb = NULL;
+static u16_t listen_port;
+
+/* Returns 0, or the error that stopped it listening on port. */
+static int server_listen(u16_t port, struct tcp_pcb **out)
+{
+	struct tcp_pcb *pcb = tcp_new_ip_type(IPADDR_TYPE_ANY);
+	if (!pcb) {
+		return ERROR_CREATE_PCB;
+	}
+
+	/* Scrapes we closed leave the port in TIME_WAIT for a while. */
+	ip_set_option(pcb, SOF_REUSEADDR);
+	if (tcp_bind(pcb, IP_ANY_TYPE, port)) {
+		tcp_close(pcb);
+		return ERROR_BIND;
+	}
+
+	*out = tcp_listen_with_backlog(pcb, 1);
+	if (!*out) {
+		tcp_close(pcb);
+		return ERROR_LISTEN;
+	}
+
+	tcp_accept(*out, server_accept);
+	return 0;
+}
+
+void server_start(void)
+{
+	int err = server_listen(settings.tcp_port, &listen_pcb);
+	if (err) {
+		fatal_error(err);
+	}
+	listen_port = settings.tcp_port;
+}
+
+static void server_stop(void)
+{
+	if (!listen_pcb)
+		return;
+	if (tcp_close(listen_pcb) != ERR_OK) {
+		fatal_error(ERROR_CLOSE);
+	}
+	listen_pcb = NULL;
+}
+
+/* Move to a new tcp_port, keeping the old listener if that fails. */
+void server_rebind(void)
+{
+	if (settings.tcp_port == listen_port)
+		return;
+
+	struct tcp_pcb *pcb;
+	if (server_listen(settings.tcp_port, &pcb)) {
+		printf("server: cannot listen on port %u, staying on %u\n", settings.tcp_port, listen_port);
+		settings.tcp_port = listen_port;
+		return;
+	}
+
+	server_stop();
+	listen_pcb = pcb;
+	listen_port = settings.tcp_port;
+}
@@ -0,0 +1,558 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+
+#include "config.h"
+#include "settings.h"
+#include "bme688_profile.h"
+
+/* Last sector of flash, well clear of the program image. */
+#define SETTINGS_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+
+static const uint32_t SETTINGS_MAGIC = 0x53485431; /* "SHT1" */
+
+struct settings settings;
+
+enum field_type {
+	FIELD_STR,
+	FIELD_IP4,	/* dotted quad, stored as a string */
+	FIELD_U8,
+	FIELD_U16,
+	FIELD_U32,
+	FIELD_S16,
+	FIELD_ENUM,
+	FIELD_GAS_PROFILE,
+	FIELD_DEADBANDS,
+};
+
+struct field {
+	const char *name;
+	enum field_type type;
+	size_t offset;
+	size_t size;
+	int32_t min, max;
+	const char *const *choices;
+	bool secret;
+	unsigned changes;
+};
+
+#if SENSOR_DRIVER_SHT4X || SENSOR_DRIVER_SHT3X
+static const char *const precision_names[] = { "high", "medium", "low", NULL };
+#endif
+#if SENSOR_DRIVER_SHT4X
+static const char *const heater_names[] = { "off", "low", "medium", "high", NULL };
+#endif
+#if SENSOR_DERIVED
+static const char *const off_on_names[] = { "off", "on", NULL };
+#endif
+#if SENSOR_PUSH_BINARY || SENSOR_PUSH_INFLUX
+/* Formats left out of this firmware are blank, so cannot be chosen. */
+static const char *const push_names[] = {
+	[PUSH_OFF]	= "off",
+	[PUSH_BINARY]	= SENSOR_PUSH_BINARY ? "binary" : "",
+	[PUSH_INFLUX]	= SENSOR_PUSH_INFLUX ? "influx" : "",
+	[PUSH_FORMATS]	= NULL,
+};
+#endif
+
+#define FIELD_AT(n) .name = #n, .offset = offsetof(struct settings, n), .size = sizeof(((struct settings *)0)->n)
+
+static const struct field fields[] = {
+	{ FIELD_AT(wlan_ssid), .type = FIELD_STR, .changes = CHANGED_WLAN },
+	{ FIELD_AT(wlan_pass), .type = FIELD_STR, .changes = CHANGED_WLAN, .secret = true },
+	{ FIELD_AT(hostname), .type = FIELD_STR, .changes = CHANGED_LISTENER },
+	{ FIELD_AT(service_name), .type = FIELD_STR, .changes = CHANGED_LISTENER },
+	{ FIELD_AT(tcp_port), .type = FIELD_U16, .min = 1, .max = 65535, .changes = CHANGED_LISTENER },
+	{ FIELD_AT(i2c_bus), .type = FIELD_U8, .min = 0, .max = 1, .changes = CHANGED_I2C },
+	{ FIELD_AT(sda_pin), .type = FIELD_U8, .min = 0, .max = 29, .changes = CHANGED_I2C },
+	{ FIELD_AT(clk_pin), .type = FIELD_U8, .min = 0, .max = 29, .changes = CHANGED_I2C },
+#if SENSOR_DRIVER_SHT4X || SENSOR_DRIVER_SHT3X
+	{ FIELD_AT(precision), .type = FIELD_ENUM, .choices = precision_names, .changes = CHANGED_SAMPLER | CHANGED_SENSOR },
+#endif
+#if SENSOR_DRIVER_SHT4X
+	{ FIELD_AT(heater), .type = FIELD_ENUM, .choices = heater_names, .changes = CHANGED_SAMPLER },
+	{ FIELD_AT(heater_every), .type = FIELD_U16, .min = 1, .max = 65535, .changes = CHANGED_SAMPLER },
+#endif
+	{ FIELD_AT(sample_interval_ms), .type = FIELD_U32, .min = 100, .max = 3'600'000, .changes = CHANGED_SAMPLER },
+#if SENSOR_DERIVED
+	{ FIELD_AT(derived), .type = FIELD_ENUM, .choices = off_on_names, .changes = CHANGED_SAMPLER },
+	{ FIELD_AT(altitude_m), .type = FIELD_S16, .min = -500, .max = 9000, .changes = CHANGED_SAMPLER },
+#endif
+#if SENSOR_DEADBAND
+	{ FIELD_AT(deadband), .type = FIELD_DEADBANDS, .changes = CHANGED_SAMPLER },
+#endif
+#if SENSOR_PUSH_BINARY || SENSOR_PUSH_INFLUX
+	{ FIELD_AT(push), .type = FIELD_ENUM, .choices = push_names, .changes = CHANGED_PUSH },
+	{ FIELD_AT(push_addr), .type = FIELD_IP4, .changes = CHANGED_PUSH },
+	{ FIELD_AT(push_port), .type = FIELD_U16, .min = 1, .max = 65535, .changes = CHANGED_PUSH },
+	{ FIELD_AT(push_ttl), .type = FIELD_U8, .min = 1, .max = 255, .changes = CHANGED_PUSH },
+	{ FIELD_AT(push_interval_ms), .type = FIELD_U32, .min = 100, .max = 3'600'000, .changes = CHANGED_PUSH },
+#endif
+#if SENSOR_DRIVER_BME688
+	{ FIELD_AT(gas_profile), .type = FIELD_GAS_PROFILE, .min = 1, .max = 400, .changes = CHANGED_SENSOR },
+	{ FIELD_AT(bme_profile), .type = FIELD_ENUM, .choices = bme_profile_names, .changes = CHANGED_SAMPLER | CHANGED_SENSOR },
+#endif
+};
+
+#define NUM_FIELDS (sizeof(fields) / sizeof(fields[0]))
+
+static uint32_t crc32(const uint8_t *data, size_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int j = 0; j < 8; j++) {
+			if (crc & 1)
+				crc = (crc >> 1) ^ 0xEDB88320;
+			else
+				crc = crc >> 1;
+		}
+	}
+	return ~crc;
+}
+
+static void copy_str(char *dst, size_t size, const char *src)
+{
+	strncpy(dst, src, size - 1);
+	dst[size - 1] = '\0';
+}
+
+/* GPIO n can only be SDA (even n) or SCL (odd n) of i2c((n / 2) % 2). */
+static bool i2c_pins_valid(void)
+{
+	return settings.sda_pin % 2 == 0 && (settings.sda_pin / 2) % 2 == settings.i2c_bus &&
+		settings.clk_pin % 2 == 1 && (settings.clk_pin / 2) % 2 == settings.i2c_bus;
+}
+
+void settings_defaults(void)
+{
+	memset(&settings, 0, sizeof(settings));
+	settings.magic = SETTINGS_MAGIC;
+	settings.version = SETTINGS_VERSION;
+	settings.size = sizeof(settings);
+
+	copy_str(settings.wlan_ssid, sizeof(settings.wlan_ssid), default_wlan_ssid);
+	copy_str(settings.wlan_pass, sizeof(settings.wlan_pass), default_wlan_pass);
+	copy_str(settings.hostname, sizeof(settings.hostname), CYW43_HOST_NAME);
+	copy_str(settings.service_name, sizeof(settings.service_name), MDNS_SERVICE_NAME);
+
+	settings.tcp_port = default_tcp_port;
+	settings.i2c_bus = default_i2c_bus;
+	settings.sda_pin = default_sda_pin;
+	settings.clk_pin = default_clk_pin;
+	settings.precision = PRECISION_HIGH;
+	settings.heater = HEATER_OFF;
+	settings.heater_every = default_heater_every;
+	settings.sample_interval_ms = default_sample_interval_ms;
+	settings.bme_profile = BME_PROFILE_PRECISE;
+
+	settings.push = PUSH_OFF;
+	copy_str(settings.push_addr, sizeof(settings.push_addr), default_push_addr);
+	settings.push_port = default_push_port;
+	settings.push_ttl = 1;
+	settings.push_interval_ms = default_push_interval_ms;
+}
+
+#define FIELD_END(n) (offsetof(struct settings, n) + sizeof(((struct settings *)0)->n))
+
+/* End of the last field of each version. */
+static const uint16_t settings_version_end[SETTINGS_VERSION + 1] = {
+	[1] = FIELD_END(sample_interval_ms),
+	[2] = FIELD_END(gas_profile),
+	[3] = FIELD_END(bme_profile),
+	[4] = FIELD_END(altitude_m),
+	[5] = FIELD_END(deadband),
+	[6] = FIELD_END(push_addr),
+};
+
+void settings_load(void)
+{
+	settings_defaults();
+
+	const uint8_t *stored = (const uint8_t *)(XIP_BASE + SETTINGS_FLASH_OFFSET);
+	struct settings header;
+	memcpy(&header, stored, offsetof(struct settings, wlan_ssid));
+
+	if (header.magic != SETTINGS_MAGIC || header.version < 1 || header.version > SETTINGS_VERSION)
+		return;
+	if (header.size <= offsetof(struct settings, wlan_ssid) || header.size > sizeof(settings))
+		return;
+
+	uint32_t crc;
+	memcpy(&crc, stored + header.size, sizeof(crc));
+	if (crc32(stored, header.size) != crc)
+		return;
+
+	/* Anything appended since this blob was written keeps its default,
+	 * including fields that overlap the old struct's tail padding. */
+	const uint16_t end = settings_version_end[header.version];
+	memcpy(&settings, stored, header.size < end ? header.size : end);
+	settings.version = SETTINGS_VERSION;
+	settings.size = sizeof(settings);
+
+	for (size_t i = 0; i < NUM_FIELDS; i++) {
+		if (fields[i].type == FIELD_STR || fields[i].type == FIELD_IP4)
+			((char *)&settings)[fields[i].offset + fields[i].size - 1] = '\0';
+	}
+
+	/* Older versions accepted heater steps longer than the sensor runs. */
+	for (uint8_t i = 0; i < settings.gas_steps && i < GAS_STEPS_MAX; i++) {
+		if (settings.gas_profile[i].dur_ms > BME_HEATER_STEP_MAX_MS)
+			settings.gas_profile[i].dur_ms = BME_HEATER_STEP_MAX_MS;
+	}
+
+	if (!i2c_pins_valid()) {
+		printf("stored I2C pins do not match the bus, using the defaults\n");
+		settings.i2c_bus = default_i2c_bus;
+		settings.sda_pin = default_sda_pin;
+		settings.clk_pin = default_clk_pin;
+	}
+}
+
+bool settings_save(void)
+{
+	static uint8_t page[(sizeof(struct settings) + sizeof(uint32_t) + FLASH_PAGE_SIZE - 1)
+		/ FLASH_PAGE_SIZE * FLASH_PAGE_SIZE];
+
+	memset(page, 0xFF, sizeof(page));
+	memcpy(page, &settings, sizeof(settings));
+	uint32_t crc = crc32(page, sizeof(settings));
+	memcpy(page + sizeof(settings), &crc, sizeof(crc));
+
+	uint32_t ints = save_and_disable_interrupts();
+	flash_range_erase(SETTINGS_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+	flash_range_program(SETTINGS_FLASH_OFFSET, page, sizeof(page));
+	restore_interrupts(ints);
+
+	return memcmp((const void *)(XIP_BASE + SETTINGS_FLASH_OFFSET), page, sizeof(page)) == 0;
+}
+
+static const struct field *field_find(const char *name)
+{
+	for (size_t i = 0; i < NUM_FIELDS; i++) {
+		if (strcmp(fields[i].name, name) == 0)
+			return &fields[i];
+	}
+	return NULL;
+}
+
+static void field_show(const struct field *f)
+{
+	const void *p = (const uint8_t *)&settings + f->offset;
+
+	printf("%s = ", f->name);
+	if (f->secret) {
+		printf("***\n");
+		return;
+	}
+
+	switch (f->type) {
+	case FIELD_STR:
+	case FIELD_IP4:
+		printf("%s\n", (const char *)p);
+		break;
+	case FIELD_U8:
+		printf("%u\n", *(const uint8_t *)p);
+		break;
+	case FIELD_U16:
+		printf("%u\n", *(const uint16_t *)p);
+		break;
+	case FIELD_U32:
+		printf("%lu\n", (unsigned long)*(const uint32_t *)p);
+		break;
+	case FIELD_S16:
+		printf("%d\n", *(const int16_t *)p);
+		break;
+	case FIELD_ENUM:
+		printf("%s\n", f->choices[*(const uint8_t *)p]);
+		break;
+	case FIELD_GAS_PROFILE:
+		if (settings.gas_steps == 0)
+			printf("off");
+		for (uint8_t i = 0; i < settings.gas_steps; i++) {
+			printf("%s%u:%u", i ? "," : "",
+				settings.gas_profile[i].temp_c, settings.gas_profile[i].dur_ms);
+		}
+		printf("\n");
+		break;
+	case FIELD_DEADBANDS:
+		if (settings.deadbands == 0)
+			printf("off");
+		for (uint8_t i = 0; i < settings.deadbands; i++) {
+			const struct deadband *db = &settings.deadband[i];
+			printf("%s%s:%g", i ? "," : "", db->name, db->band);
+			if (db->silence_s)
+				printf(":%lu", (unsigned long)db->silence_s);
+		}
+		printf("\n");
+		break;
+	}
+}
+
+/* Parses "name:band[:silence_s],..." or "off". */
+static bool deadbands_set(const char *value)
+{
+	struct deadband deadband[DEADBANDS_MAX];
+	uint8_t count = 0;
+
+	if (strcmp(value, "off") != 0) {
+		const char *p = value;
+		while (*p) {
+			if (count == DEADBANDS_MAX)
+				return false;
+
+			struct deadband *db = &deadband[count];
+			const size_t len = strcspn(p, ":");
+			if (len == 0 || len >= sizeof(db->name) || p[len] != ':')
+				return false;
+			memcpy(db->name, p, len);
+			db->name[len] = '\0';
+			p += len + 1;
+
+			char *end;
+			db->band = strtof(p, &end);
+			if (end == p || !(db->band >= 0.0f))
+				return false;
+			p = end;
+
+			db->silence_s = 0;
+			if (*p == ':') {
+				p++;
+				db->silence_s = strtoul(p, &end, 10);
+				if (end == p)
+					return false;
+				p = end;
+			}
+			count++;
+
+			if (*p == ',')
+				p++;
+			else if (*p)
+				return false;
+		}
+	}
+
+	memcpy(settings.deadband, deadband, count * sizeof(deadband[0]));
+	settings.deadbands = count;
+	return true;
+}
+
+/* Parses "temp_c:dur_ms,..." or "off". */
+static bool gas_profile_set(const struct field *f, const char *value)
+{
+	struct gas_step profile[GAS_STEPS_MAX];
+	uint8_t steps = 0;
+
+	if (strcmp(value, "off") != 0) {
+		const char *p = value;
+		while (*p) {
+			if (steps == GAS_STEPS_MAX)
+				return false;
+
+			char *end;
+			unsigned long temp = strtoul(p, &end, 10);
+			if (end == p || *end != ':' || temp < f->min || temp > f->max)
+				return false;
+			p = end + 1;
+
+			unsigned long dur = strtoul(p, &end, 10);
+			if (end == p || dur == 0 || dur > BME_HEATER_STEP_MAX_MS)
+				return false;
+			p = end;
+
+			profile[steps].temp_c = temp;
+			profile[steps].dur_ms = dur;
+			steps++;
+
+			if (*p == ',')
+				p++;
+			else if (*p)
+				return false;
+		}
+	}
+
+	memcpy(settings.gas_profile, profile, steps * sizeof(profile[0]));
+	settings.gas_steps = steps;
+	return true;
+}
+
+static bool ip4_valid(const char *value)
+{
+	unsigned a, b, c, d;
+	char end;
+	return sscanf(value, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) == 4 &&
+		a <= 255 && b <= 255 && c <= 255 && d <= 255;
+}
+
+static bool field_set(const struct field *f, const char *value)
+{
+	void *p = (uint8_t *)&settings + f->offset;
+
+	if (f->type == FIELD_IP4 && !ip4_valid(value))
+		return false;
+
+	if (f->type == FIELD_STR || f->type == FIELD_IP4) {
+		if (strlen(value) >= f->size)
+			return false;
+		copy_str(p, f->size, value);
+		return true;
+	}
+
+	if (f->type == FIELD_GAS_PROFILE)
+		return gas_profile_set(f, value);
+
+	if (f->type == FIELD_DEADBANDS)
+		return deadbands_set(value);
+
+	if (f->type == FIELD_ENUM) {
+		for (uint8_t i = 0; f->choices[i]; i++) {
+			if (*f->choices[i] && strcmp(f->choices[i], value) == 0) {
+				*(uint8_t *)p = i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	char *end;
+	long v = strtol(value, &end, 0);
+	if (*value == '\0' || *end != '\0' || v < f->min || v > f->max)
+		return false;
+
+	/* Which bus a pin belongs to is checked on apply, once all three
+	 * may have been changed. */
+	if (f->offset == offsetof(struct settings, sda_pin) && v % 2 != 0)
+		return false;
+	if (f->offset == offsetof(struct settings, clk_pin) && v % 2 != 1)
+		return false;
+
+	switch (f->type) {
+	case FIELD_U8:
+		*(uint8_t *)p = v;
+		break;
+	case FIELD_U16:
+		*(uint16_t *)p = v;
+		break;
+	case FIELD_S16:
+		*(int16_t *)p = v;
+		break;
+	default:
+		*(uint32_t *)p = v;
+		break;
+	}
+	return true;
+}
+
+static const unsigned CHANGED_ALL = CHANGED_WLAN | CHANGED_LISTENER | CHANGED_I2C | CHANGED_SAMPLER | CHANGED_SENSOR | CHANGED_PUSH;
+
+/* Rejoining drops the connection, so only report CHANGED_WLAN if the
+ * credentials really differ. */
+static unsigned settings_replace(void (*replace)(void))
+{
+	char ssid[sizeof(settings.wlan_ssid)], pass[sizeof(settings.wlan_pass)];
+	memcpy(ssid, settings.wlan_ssid, sizeof(ssid));
+	memcpy(pass, settings.wlan_pass, sizeof(pass));
+
+	replace();
+
+	if (strcmp(ssid, settings.wlan_ssid) == 0 && strcmp(pass, settings.wlan_pass) == 0)
+		return CHANGED_ALL & ~CHANGED_WLAN;
+	return CHANGED_ALL;
+}
+
+/* I2C changes wait for apply or save, as moving the sensor takes several
+ * sets and the bus cannot work in between. */
+static unsigned pending = 0;
+
+static unsigned settings_apply_pending(void)
+{
+	if (!i2c_pins_valid()) {
+		printf("sda_pin and clk_pin must be SDA and SCL pins of i2c_bus\n");
+		return 0;
+	}
+	unsigned changed = pending;
+	pending = 0;
+	return changed;
+}
+
+static unsigned settings_command(char *line)
+{
+	char *cmd = strtok(line, " ");
+
+	if (!cmd) {
+		return 0;
+	} else if (strcmp(cmd, "show") == 0) {
+		for (size_t i = 0; i < NUM_FIELDS; i++)
+			field_show(&fields[i]);
+	} else if (strcmp(cmd, "set") == 0) {
+		const char *name = strtok(NULL, " ");
+		const char *value = strtok(NULL, "");
+		const struct field *f = name ? field_find(name) : NULL;
+		if (!f) {
+			printf("unknown setting\n");
+		} else if (!field_set(f, value ? value : "")) {
+			printf("bad value for %s\n", f->name);
+		} else {
+			field_show(f);
+#if SENSOR_DRIVER_BME688
+			/* A profile brings its own sample rate, which can
+			 * still be overridden afterwards. */
+			if (f->offset == offsetof(struct settings, bme_profile)) {
+				settings.sample_interval_ms = bme_profiles[settings.bme_profile].interval_ms;
+				field_show(field_find("sample_interval_ms"));
+			}
+#endif
+			if (f->changes & CHANGED_I2C) {
+				pending |= f->changes;
+				printf("takes effect on apply or save\n");
+				return 0;
+			}
+			return f->changes;
+		}
+	} else if (strcmp(cmd, "apply") == 0) {
+		return settings_apply_pending();
+	} else if (strcmp(cmd, "save") == 0) {
+		if (pending && !i2c_pins_valid()) {
+			printf("sda_pin and clk_pin must be SDA and SCL pins of i2c_bus\n");
+			return 0;
+		}
+		printf(settings_save() ? "saved\n" : "save failed\n");
+		return settings_apply_pending();
+	} else if (strcmp(cmd, "load") == 0) {
+		pending = 0;
+		return settings_replace(settings_load);
+	} else if (strcmp(cmd, "defaults") == 0) {
+		pending = 0;
+		return settings_replace(settings_defaults);
+	} else if (strcmp(cmd, "reboot") == 0) {
+		watchdog_reboot(0, 0, 0);
+	} else {
+		printf("commands: show, set <name> <value>, apply, save, load, defaults, reboot\n");
+	}
+	return 0;
+}
+
+unsigned settings_poll(void)
+{
+	static char line[160];
+	static size_t len = 0;
+
+	unsigned changed = 0;
+	int c;
+	while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+		if (c == '\r' || c == '\n') {
+			line[len] = '\0';
+			changed |= settings_command(line);
+			len = 0;
+		} else if (len < sizeof(line) - 1) {
+			line[len++] = c;
+		}
+	}
+	return changed;
+}
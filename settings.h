@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hardware/i2c.h"
+
+/* Bump whenever fields are appended, and add the new last field to
+ * settings_version_end in settings.c. Fields must only ever be appended,
+ * so that an older blob can be loaded over the defaults. New fields may
+ * start inside the old struct's tail padding, so only the bytes up to the
+ * end of the stored version's last field are loaded. */
+#define SETTINGS_VERSION 6
+
+enum settings_precision {
+	PRECISION_HIGH = 0,
+	PRECISION_MEDIUM,
+	PRECISION_LOW,
+};
+
+enum settings_heater {
+	HEATER_OFF = 0,
+	HEATER_LOW,
+	HEATER_MEDIUM,
+	HEATER_HIGH,
+};
+
+enum settings_push {
+	PUSH_OFF = 0,
+	PUSH_BINARY,
+	PUSH_INFLUX,
+	PUSH_FORMATS,
+};
+
+#define GAS_STEPS_MAX 10
+
+/* One step of a gas heater profile. */
+struct gas_step {
+	uint16_t temp_c;
+	uint16_t dur_ms;
+};
+
+#define DEADBANDS_MAX 8
+
+/* Change needed before a metric is reported again, and the longest it
+ * may go unreported regardless (0 for no limit). */
+struct deadband {
+	char name[24];
+	float band;
+	uint32_t silence_s;
+};
+
+struct settings {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t size;
+
+	char wlan_ssid[33];
+	char wlan_pass[64];
+	char hostname[33];
+	char service_name[64];
+
+	uint16_t tcp_port;
+	uint8_t i2c_bus;
+	uint8_t sda_pin;
+	uint8_t clk_pin;
+	uint8_t precision;
+	uint8_t heater;
+	uint16_t heater_every;
+	uint32_t sample_interval_ms;
+
+	/* Version 2 */
+	uint8_t gas_steps;
+	struct gas_step gas_profile[GAS_STEPS_MAX];
+
+	/* Version 3 */
+	uint8_t bme_profile;
+
+	/* Version 4 */
+	uint8_t derived;
+	int16_t altitude_m;
+
+	/* Version 5 */
+	uint8_t deadbands;
+	struct deadband deadband[DEADBANDS_MAX];
+
+	/* Version 6 */
+	uint8_t push;
+	uint8_t push_ttl;
+	uint16_t push_port;
+	uint32_t push_interval_ms;
+	char push_addr[16];
+};
+
+/* What a change to a setting needs re-applied. */
+enum settings_changed {
+	CHANGED_WLAN		= 1 << 0,
+	CHANGED_LISTENER	= 1 << 1,
+	CHANGED_I2C		= 1 << 2,
+	CHANGED_SAMPLER		= 1 << 3,
+	CHANGED_SENSOR		= 1 << 4,
+	CHANGED_PUSH		= 1 << 5,
+};
+
+extern struct settings settings;
+
+#define our_i2c i2c_get_instance(settings.i2c_bus)
+
+void settings_load(void);
+bool settings_save(void);
+void settings_defaults(void);
+
+/* Feed pending USB serial input to the console.
+ * Returns a mask of enum settings_changed for the caller to apply. */
+unsigned settings_poll(void);
@@ -0,0 +1,30 @@
+#include "sht.h"
+
+uint8_t crc8(const uint8_t *data)
+{
+	uint8_t crc = 0xFF;
+	for (int i = 0; i < 2; i++) {
+		crc ^= data[i];
+		for (int j = 0; j < 8; j++) {
+			if (crc & 0x80)
+				crc = (crc << 1) ^ 0x31;
+			else
+				crc = crc << 1;
+		}
+	}
+	return crc;
+}
+
+struct measurement *sht_measurements(double temp, double humid)
+{
+	static struct measurement ms[3] = {
+		{ .name = "temp", .type = "gauge" },
+		{ .name = "humid", .type = "gauge" },
+		{ 0 }
+	};
+
+	ms[0].value = temp;
+	ms[1].value = humid;
+
+	return ms;
+}
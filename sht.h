@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "sensor.h"
+
+/* Shared by the SHT3x and SHT4x drivers. */
+
+static const unsigned char SHT_I2C_ADDR = 0x44;
+
+/* CRC-8 over the two bytes of a data word, polynomial 0x31. */
+uint8_t crc8(const uint8_t *data);
+
+/* Fill in the shared temp/humid table. */
+struct measurement *sht_measurements(double temp, double humid);
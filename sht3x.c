@@ -1,13 +1,24 @@
-#include "/usr/local/include/util/string.h"
+#include <stdint.h>
 
-#include "main.c"
-#include "config.h"
+#include "pico/stdlib.h"
+
+#include "hardware/i2c.h"
+
+#include "sensor.h"
+#include "settings.h"
+#include "sht.h"
 
 enum sht3_cmd {
 	SHT3_CMD_MEASURE_CS_HP	= 0x2C06,
+	SHT3_CMD_MEASURE_CS_MP	= 0x2C0D,
+	SHT3_CMD_MEASURE_CS_LP	= 0x2C10,
 };
 
-static const unsigned char SHT_I2C_ADDR = 0x44;
+static const uint16_t sht3_measure_cmd[] = {
+	[PRECISION_HIGH]	= SHT3_CMD_MEASURE_CS_HP,
+	[PRECISION_MEDIUM]	= SHT3_CMD_MEASURE_CS_MP,
+	[PRECISION_LOW]		= SHT3_CMD_MEASURE_CS_LP,
+};
 
 enum sht_error {
 	ERROR_SHT3_READ = 1,
@@ -15,22 +26,7 @@ enum sht_error {
 	ERROR_SHT3_CHECKSUM,
 };
 
-uint8_t crc8(uint8_t *data)
-{
-	uint8_t crc = 0xFF;
-	for (int i = 0; i < 2; i++) {
-		crc ^= data[i];
-		for (int j = 0; j < 8; j++) {
-			if (crc & 0x80)
-				crc = (crc << 1) ^ 0x31;
-			else
-				crc = crc << 1;
-		}
-	}
-	return crc;
-}
-
-void sht_cmd_blocking(uint16_t cmd, uint16_t *buf)
+static void sht_cmd_blocking(uint16_t cmd, uint16_t *buf)
 {
 	uint8_t cmd_b[] = { (cmd >> 8) & 0xFF, cmd & 0xFF };
 	if (i2c_write_blocking(our_i2c, SHT_I2C_ADDR, &cmd_b, 2, false) != 2) {
@@ -55,7 +51,7 @@ void sht_cmd_blocking(uint16_t cmd, uint16_t *buf)
 	}
 }
 
-void measure_init(void)
+static void sht3x_init(void)
 {
 	/* Test vector from spec. */
 	uint8_t chk[2] = {0xBE, 0xEF};
@@ -67,23 +63,19 @@ void measure_init(void)
 	sht_cmd_blocking(SHT3_CMD_MEASURE_CS_HP, NULL);
 }
 
-struct measurement *measure_take(void)
+static struct measurement *sht3x_take(void)
 {
-	static struct measurement ms[3] = {
-		{ .name = "temp", .type = "gauge", .value = NULL },
-		{ .name = "humid", .type = "gauge", .value = NULL },
-		{ 0 }
-	};
-
 	uint16_t buf[2] = {0, 0};
-	sht_cmd_blocking(SHT3_CMD_MEASURE_CS_HP, buf);
+	sht_cmd_blocking(sht3_measure_cmd[settings.precision], buf);
 
 	double temp = (175.0 * ((double)buf[0] / 65535.0)) - 45.0;
 	double humid = 100.0 * ((double)buf[1] / 65535.0);
 
-	ms[0].value = rsprintf(ms[0].value, "%f", temp);
-	ms[1].value = rsprintf(ms[1].value, "%f", humid);
-
-	return ms;
+	return sht_measurements(temp, humid);
 }
 
+const struct sensor_driver sht3x_driver = {
+	.init = sht3x_init,
+	.take = sht3x_take,
+};
+
@@ -1,7 +1,12 @@
-#include "/usr/local/include/util/string.h"
+#include <stdint.h>
 
-#include "main.c"
-#include "config.h"
+#include "pico/stdlib.h"
+
+#include "hardware/i2c.h"
+
+#include "sensor.h"
+#include "settings.h"
+#include "sht.h"
 
 enum sht_cmd {
 	SHT_CMD_MEASURE_HP		= 0xFD,
@@ -21,7 +26,20 @@ enum sht_cmd {
  * Spec. says max is 8ms, so this is plenty. */
 static const unsigned char SHT_DELAY_MEASURE = 25;
 
-static const unsigned char SHT_I2C_ADDR = 0x44;
+/* Delay for 100ms heater pulses, spec. says max is 110ms. */
+static const unsigned char SHT_DELAY_HEAT = 120;
+
+static const uint8_t sht_measure_cmd[] = {
+	[PRECISION_HIGH]	= SHT_CMD_MEASURE_HP,
+	[PRECISION_MEDIUM]	= SHT_CMD_MEASURE_MP,
+	[PRECISION_LOW]		= SHT_CMD_MEASURE_LP,
+};
+
+static const uint8_t sht_heat_cmd[] = {
+	[HEATER_LOW]		= SHT_CMD_HEAT_20mW_100ms,
+	[HEATER_MEDIUM]		= SHT_CMD_HEAT_110mW_100ms,
+	[HEATER_HIGH]		= SHT_CMD_HEAT_200mW_100ms,
+};
 
 enum sht_error {
 	ERROR_SHT_CHECKSERIAL_READ = 1,
@@ -32,28 +50,13 @@ enum sht_error {
 	ERROR_SHT_CHECKSUM,
 };
 
-uint8_t crc8(uint8_t *data)
-{
-	uint8_t crc = 0xFF;
-	for (int i = 0; i < 2; i++) {
-		crc ^= data[i];
-		for (int j = 0; j < 8; j++) {
-			if (crc & 0x80)
-				crc = (crc << 1) ^ 0x31;
-			else
-				crc = crc << 1;
-		}
-	}
-	return crc;
-}
-
-void sht_cmd_blocking(uint8_t cmd, uint16_t *buf)
+static void sht_cmd_blocking(uint8_t cmd, uint16_t *buf, unsigned delay)
 {
 	if (i2c_write_blocking(our_i2c, SHT_I2C_ADDR, &cmd, 1, false) != 1) {
 		fatal_error(ERROR_SHT_READ);
 	}
 
-	sleep_ms(SHT_DELAY_MEASURE);
+	sleep_ms(delay);
 
 	uint8_t data[6] = { 0 };
 	if (i2c_read_blocking(our_i2c, SHT_I2C_ADDR, data, sizeof(data), false) != sizeof(data)) {
@@ -69,7 +72,7 @@ void sht_cmd_blocking(uint8_t cmd, uint16_t *buf)
 	buf[1] = (data[3] << 8) | data[4];
 }
 
-void measure_init(void)
+static void sht4x_init(void)
 {
 	/* Test vector from spec. */
 	uint8_t chk[2] = {0xBE, 0xEF};
@@ -96,23 +99,31 @@ void measure_init(void)
 		fatal_error(ERROR_SHT_CHECKSERIAL_CHECKSUM);
 }
 
-struct measurement *measure_take(void)
+static struct measurement *sht4x_take(void)
 {
-	static struct measurement ms[3] = {
-		{ .name = "temp", .type = "gauge", .value = NULL },
-		{ .name = "humid", .type = "gauge", .value = NULL },
-		{ 0 }
-	};
+	static unsigned since_heat = 0;
 
 	uint16_t buf[2] = {0, 0};
-	sht_cmd_blocking(SHT_CMD_MEASURE_HP, buf);
+
+	sht_cmd_blocking(sht_measure_cmd[settings.precision], buf, SHT_DELAY_MEASURE);
+
+	/* Pulse the heater to drive off condensation only after measuring,
+	 * so it has the whole sample interval to cool back down to ambient.
+	 * The reading taken while heating is discarded. */
+	if (settings.heater != HEATER_OFF && ++since_heat >= settings.heater_every) {
+		uint16_t hot[2];
+		sht_cmd_blocking(sht_heat_cmd[settings.heater], hot, SHT_DELAY_HEAT);
+		since_heat = 0;
+	}
 
 	double temp = (175.0 * ((double)buf[0] / 65535.0)) - 45.0;
 	double humid = (125.0 * ((double)buf[1] / 65535.0)) - 6.0;
 
-	ms[0].value = rsprintf(ms[0].value, "%f", temp);
-	ms[1].value = rsprintf(ms[1].value, "%f", humid);
-
-	return ms;
+	return sht_measurements(temp, humid);
 }
 
+const struct sensor_driver sht4x_driver = {
+	.init = sht4x_init,
+	.take = sht4x_take,
+};
+
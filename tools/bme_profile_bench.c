@@ -0,0 +1,52 @@
+/* Host model of the duty cycle and average current of each BME688
+ * measurement profile in forced mode.
+ *
+ *   cc -std=c2x -O2 -I.. -o bme_profile_bench bme_profile_bench.c
+ *
+ * Currents are the typical figures from the BME680/BME688 datasheets and
+ * are only meant for comparing profiles against each other. */
+
+#include <stdio.h>
+
+#include "bme688_profile.h"
+
+static const double IDD_TEMP_UA = 350.0;
+static const double IDD_PRESS_UA = 714.0;
+static const double IDD_HUM_UA = 340.0;
+/* Switching, gas and wake up overhead, taken as a temperature conversion. */
+static const double IDD_OVERHEAD_UA = 350.0;
+static const double IDD_SLEEP_UA = 0.15;
+
+static const double CYCLE_MS = 1.963;
+
+int main(void)
+{
+	printf("%-8s %8s %8s %10s %10s %12s\n",
+		"profile", "osrs", "filter", "conv_ms", "duty_%", "avg_uA");
+
+	for (int i = 0; i < BME_PROFILES; i++) {
+		const struct bme_profile *p = &bme_profiles[i];
+
+		const double
+			conv_ms = bme_profile_dur_us(p, false) / 1000.0,
+			t_ms = bme_oversample_cycles[p->osrs_t] * CYCLE_MS,
+			p_ms = bme_oversample_cycles[p->osrs_p] * CYCLE_MS,
+			h_ms = bme_oversample_cycles[p->osrs_h] * CYCLE_MS,
+			rest_ms = conv_ms - t_ms - p_ms - h_ms,
+			active_uA_ms = t_ms * IDD_TEMP_UA + p_ms * IDD_PRESS_UA +
+				h_ms * IDD_HUM_UA + rest_ms * IDD_OVERHEAD_UA,
+			avg_uA = (active_uA_ms + (p->interval_ms - conv_ms) * IDD_SLEEP_UA) / p->interval_ms;
+
+		char osrs[16];
+		snprintf(osrs, sizeof(osrs), "%u/%u/%u",
+			bme_oversample_cycles[p->osrs_t],
+			bme_oversample_cycles[p->osrs_p],
+			bme_oversample_cycles[p->osrs_h]);
+
+		printf("%-8s %8s %8u %10.3f %10.4f %12.3f\n",
+			bme_profile_names[i], osrs, (1u << p->filter) - 1,
+			conv_ms, 100.0 * conv_ms / p->interval_ms, avg_uA);
+	}
+
+	return 0;
+}
@@ -0,0 +1,97 @@
+/* Accuracy and speed of the single precision derived quantities against
+ * the double precision Magnus and hypsometric formulas.
+ *
+ *   cc -std=c2x -O2 -I.. -o derived_bench derived_bench.c ../derived.c -lm
+ *
+ * Timings are host timings; only the ratio is indicative of the RP2040. */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "derived.h"
+
+static double exact_svp(double t)
+{
+	return 6.112 * exp(17.62 * t / (243.12 + t));
+}
+
+static double exact_dew_point(double t, double rh)
+{
+	const double gamma = log(rh / 100.0) + 17.62 * t / (243.12 + t);
+	return 243.12 * gamma / (17.62 - gamma);
+}
+
+static double exact_abs_humid(double t, double rh)
+{
+	return 216.7 * exact_svp(t) * rh / 100.0 / (273.15 + t);
+}
+
+static double exact_vpd(double t, double rh)
+{
+	return exact_svp(t) * (100.0 - rh) / 1000.0;
+}
+
+static double exact_sea_level(double p, double t, double h)
+{
+	return p * pow(1.0 - 0.0065 * h / (t + 0.0065 * h + 273.15), -5.257);
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static volatile double sink;
+
+#define TIME(label, expr) do { \
+		const double start = now_ns(); \
+		int n = 0; \
+		for (int r = 0; r < REPEAT; r++) \
+			for (double t = -20.0; t <= 50.0; t += 0.5) \
+				for (double rh = 5.0; rh <= 100.0; rh += 1.0, n++) \
+					sink = (expr); \
+		printf("%-24s %8.2f ns/op\n", label, (now_ns() - start) / n); \
+	} while (0)
+
+enum {
+	REPEAT = 50,
+};
+
+int main(void)
+{
+	double err_dp = 0, err_ah = 0, err_vpd = 0, err_slp = 0;
+
+	for (double t = -20.0; t <= 50.0; t += 0.1) {
+		for (double rh = 1.0; rh <= 100.0; rh += 0.5) {
+			err_dp = fmax(err_dp, fabs(dew_point(t, rh) - exact_dew_point(t, rh)));
+			err_ah = fmax(err_ah, fabs(abs_humid(t, rh) - exact_abs_humid(t, rh)));
+			err_vpd = fmax(err_vpd, fabs(vpd(t, rh) - exact_vpd(t, rh)));
+		}
+		for (double h = -400.0; h <= 4000.0; h += 50.0) {
+			err_slp = fmax(err_slp, fabs(sea_level_pressure(95000.0f, t, h) - exact_sea_level(95000.0, t, h)));
+		}
+	}
+
+	printf("max abs error, -20..50 C, 1..100 %%RH\n");
+	printf("%-24s %10.6f C\n", "dew_point", err_dp);
+	printf("%-24s %10.6f g/m^3\n", "abs_humid", err_ah);
+	printf("%-24s %10.6f kPa\n", "vpd", err_vpd);
+	printf("%-24s %10.6f Pa\n", "sea_level_pressure", err_slp);
+	printf("\n");
+
+	TIME("dew_point float", dew_point(t, rh));
+	TIME("dew_point double", exact_dew_point(t, rh));
+	TIME("abs_humid float", abs_humid(t, rh));
+	TIME("abs_humid double", exact_abs_humid(t, rh));
+	TIME("vpd float", vpd(t, rh));
+	TIME("vpd double", exact_vpd(t, rh));
+	TIME("sea_level float", sea_level_pressure(95000.0f, t, rh * 40.0));
+	TIME("sea_level double", exact_sea_level(95000.0, t, rh * 40.0));
+
+	return 0;
+}
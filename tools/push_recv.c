@@ -0,0 +1,365 @@
+/* Collector and load generator for the UDP push output.
+ *
+ *   cc -std=c2x -O2 -I.. -o push_recv push_recv.c
+ *
+ *   push_recv [-g group] [-p port] [-v]
+ *	Receive binary or InfluxDB datagrams, printing per second ingestion
+ *	rates and datagrams lost, going by each node's sequence numbers.
+ *	-v also prints every snapshot.
+ *
+ *   push_recv -s nodes [-g group] [-p port] [-r rate] [-t seconds]
+ *	Send synthetic binary snapshots from that many fake nodes, at rate
+ *	datagrams per second in total (0, the default, for flat out), to
+ *	measure what a collector can ingest. */
+
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "push.h"
+
+enum {
+	NODES_MAX = 4096,
+	SNAPSHOT_ENTRIES = 8,
+};
+
+struct node {
+	char host[33];
+	uint32_t next_seq;
+	uint64_t received;
+	uint64_t lost;
+};
+
+static struct node nodes[NODES_MAX];
+static int num_nodes = 0;
+
+static double now_s(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static struct node *node_find(const char *host)
+{
+	for (int i = 0; i < num_nodes; i++) {
+		if (strcmp(nodes[i].host, host) == 0)
+			return &nodes[i];
+	}
+	if (num_nodes == NODES_MAX)
+		return NULL;
+
+	struct node *n = &nodes[num_nodes++];
+	snprintf(n->host, sizeof(n->host), "%s", host);
+	return n;
+}
+
+/* Count the datagrams skipped since the node's last one. Anything going
+ * backwards is taken as a reboot rather than reordering. */
+static void node_seq(struct node *n, uint32_t seq)
+{
+	if (n->received && seq > n->next_seq)
+		n->lost += seq - n->next_seq;
+	n->next_seq = seq + 1;
+	n->received++;
+}
+
+/* Returns the number of entries, or -1 if malformed. */
+static int parse_binary(const uint8_t *buf, size_t len, bool verbose)
+{
+	struct push_header header;
+	if (len < sizeof(header))
+		return -1;
+	memcpy(&header, buf, sizeof(header));
+
+	const size_t names_len = ntohs(header.names_len);
+	if (header.version != PUSH_VERSION || names_len % 4 ||
+	    len < sizeof(header) + names_len + header.count * sizeof(uint32_t))
+		return -1;
+
+	char host[sizeof(header.host) + 1];
+	snprintf(host, sizeof(host), "%.*s", (int)sizeof(header.host), header.host);
+	struct node *n = node_find(host);
+	if (n)
+		node_seq(n, ntohl(header.seq));
+
+	if (verbose)
+		printf("%s seq=%u uptime_ms=%u\n", host, ntohl(header.seq), ntohl(header.uptime_ms));
+
+	const char *name = (const char *)buf + sizeof(header);
+	const char *names_end = name + names_len;
+	const uint8_t *values = buf + sizeof(header) + names_len;
+	for (int i = 0; i < header.count; i++) {
+		const size_t n = strnlen(name, names_end - name);
+		if (n == (size_t)(names_end - name))
+			return -1;
+
+		uint32_t bits;
+		memcpy(&bits, values + i * sizeof(bits), sizeof(bits));
+		bits = ntohl(bits);
+		float value;
+		memcpy(&value, &bits, sizeof(value));
+		if (verbose)
+			printf("\t%s %f\n", name, value);
+		name += n + 1;
+	}
+	return header.count;
+}
+
+/* Only the first line carries host and seq, the rest are counted. */
+static int parse_influx(const uint8_t *buf, size_t len, bool verbose)
+{
+	char text[2048];
+	if (len >= sizeof(text))
+		return -1;
+	memcpy(text, buf, len);
+	text[len] = '\0';
+
+	char host[33];
+	unsigned long seq;
+	const char *h = strstr(text, "host=");
+	const char *s = strstr(text, " seq=");
+	if (!h || !s || sscanf(h, "host=%32[^ ,]", host) != 1 || sscanf(s, " seq=%luu", &seq) != 1)
+		return -1;
+
+	struct node *n = node_find(host);
+	if (n)
+		node_seq(n, seq);
+
+	if (verbose)
+		fputs(text, stdout);
+
+	/* Fields follow the first space of each line, tags precede it. */
+	int fields = 0;
+	bool in_fields = false;
+	for (const char *c = text; *c; c++) {
+		if (*c == '\n')
+			in_fields = false;
+		else if (*c == ' ')
+			in_fields = true;
+		else if (*c == '=' && in_fields)
+			fields++;
+	}
+	return fields;
+}
+
+static int open_socket(const char *group, int port, bool receive)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		exit(1);
+	}
+
+	struct in_addr addr;
+	if (!inet_aton(group, &addr)) {
+		fprintf(stderr, "bad address %s\n", group);
+		exit(1);
+	}
+
+	if (!receive)
+		return fd;
+
+	const int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	/* Deep buffer so bursts from the whole fleet are not dropped here. */
+	const int rcvbuf = 8 << 20;
+	setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+	struct sockaddr_in sin = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+		.sin_addr.s_addr = htonl(INADDR_ANY),
+	};
+	if (bind(fd, (struct sockaddr *)&sin, sizeof(sin)) < 0) {
+		perror("bind");
+		exit(1);
+	}
+
+	if (IN_MULTICAST(ntohl(addr.s_addr))) {
+		struct ip_mreq mreq = {
+			.imr_multiaddr = addr,
+			.imr_interface.s_addr = htonl(INADDR_ANY),
+		};
+		if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+			perror("IP_ADD_MEMBERSHIP");
+			exit(1);
+		}
+	}
+	return fd;
+}
+
+static int receive(const char *group, int port, bool verbose)
+{
+	int fd = open_socket(group, port, true);
+
+	const struct timeval tv = { .tv_sec = 0, .tv_usec = 100'000 };
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	uint64_t datagrams = 0, entries = 0, bytes = 0, malformed = 0;
+	double next_report = now_s() + 1.0, last_report = now_s();
+
+	while (1) {
+		uint8_t buf[2048];
+		ssize_t len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+			perror("recv");
+			return 1;
+		}
+
+		if (len > 0) {
+			uint32_t magic;
+			memcpy(&magic, buf, sizeof(magic));
+			int n = (size_t)len >= sizeof(magic) && ntohl(magic) == PUSH_MAGIC
+				? parse_binary(buf, len, verbose)
+				: parse_influx(buf, len, verbose);
+			if (n < 0) {
+				malformed++;
+			} else {
+				datagrams++;
+				entries += n;
+				bytes += len;
+			}
+		}
+
+		const double now = now_s();
+		if (now >= next_report) {
+			uint64_t lost = 0;
+			for (int i = 0; i < num_nodes; i++)
+				lost += nodes[i].lost;
+
+			const double dt = now - last_report;
+			fprintf(stderr, "nodes %d  %.0f datagrams/s  %.0f entries/s  %.1f kB/s  lost %llu  malformed %llu\n",
+				num_nodes, datagrams / dt, entries / dt, bytes / dt / 1000.0,
+				(unsigned long long)lost, (unsigned long long)malformed);
+
+			datagrams = entries = bytes = 0;
+			last_report = now;
+			next_report = now + 1.0;
+		}
+	}
+}
+
+static int send_load(const char *group, int port, int num_senders, double rate, double seconds)
+{
+	int fd = open_socket(group, port, false);
+
+	struct sockaddr_in dst = {
+		.sin_family = AF_INET,
+		.sin_port = htons(port),
+	};
+	inet_aton(group, &dst.sin_addr);
+
+	static const char *const names[SNAPSHOT_ENTRIES] = {
+		"temp", "humid", "pressure", "dew_point", "abs_humid", "vpd", "sea_level_pressure", "sampler_suppressed_ratio",
+	};
+
+	uint8_t buf[PUSH_DATAGRAM_MAX];
+	uint32_t *seq = calloc(num_senders, sizeof(*seq));
+
+	const double start = now_s();
+	uint64_t sent = 0, failed = 0;
+	while (now_s() - start < seconds) {
+		for (int i = 0; i < num_senders; i++) {
+			size_t len = sizeof(struct push_header);
+			for (int j = 0; j < SNAPSHOT_ENTRIES; j++) {
+				const size_t n = strlen(names[j]) + 1;
+				memcpy(buf + len, names[j], n);
+				len += n;
+			}
+			while (len % 4)
+				buf[len++] = '\0';
+
+			struct push_header header = {
+				.magic = htonl(PUSH_MAGIC),
+				.version = PUSH_VERSION,
+				.count = SNAPSHOT_ENTRIES,
+				.names_len = htons(len - sizeof(header)),
+				.seq = htonl(seq[i]++),
+				.uptime_ms = htonl((uint32_t)((now_s() - start) * 1000)),
+			};
+			char host[sizeof(header.host) + 1];
+			snprintf(host, sizeof(host), "node%04d", i);
+			memcpy(header.host, host, strlen(host));
+			memcpy(buf, &header, sizeof(header));
+
+			for (int j = 0; j < SNAPSHOT_ENTRIES; j++) {
+				const float value = 20.0f + j + sinf(sent * 0.001f);
+				uint32_t bits;
+				memcpy(&bits, &value, sizeof(bits));
+				bits = htonl(bits);
+				memcpy(buf + len, &bits, sizeof(bits));
+				len += sizeof(bits);
+			}
+
+			if (sendto(fd, buf, len, 0, (struct sockaddr *)&dst, sizeof(dst)) < 0)
+				failed++;
+			else
+				sent++;
+
+			if (rate > 0) {
+				const double due = start + sent / rate;
+				const double wait = due - now_s();
+				if (wait > 0)
+					usleep(wait * 1e6);
+			}
+		}
+	}
+
+	const double elapsed = now_s() - start;
+	fprintf(stderr, "sent %llu datagrams from %d nodes in %.1fs, %.0f/s, %llu failed\n",
+		(unsigned long long)sent, num_senders, elapsed, sent / elapsed, (unsigned long long)failed);
+	free(seq);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *group = "239.255.72.84";
+	int port = 8125, senders = 0;
+	double rate = 0, seconds = 10;
+	bool verbose = false;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "g:p:s:r:t:v")) != -1) {
+		switch (opt) {
+		case 'g':
+			group = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 's':
+			senders = atoi(optarg);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 't':
+			seconds = atof(optarg);
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-g group] [-p port] [-v] | -s nodes [-r rate] [-t seconds]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	if (senders > 0)
+		return send_load(group, port, senders, rate, seconds);
+	return receive(group, port, verbose);
+}